@@ -0,0 +1,158 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * ALLOCBENCH: Heap allocations & time per iteration of the MRW loop, for
+ *             every solver.
+ *
+ * AllocBench : For every solver (LxT, LxTit, LxTmix & LxTk), the MRW loop
+ *      of main.cpp (mrwChain, see Chain.h) runs nI iterations from p0, with
+ *      the summaries & ICs on from the start (sumB = 0) and the output files
+ *      written to /dev/null. The heap allocations (glibc malloc &
+ *      posix_memalign, which Armadillo uses) of iterations 3 to nI, i.e.
+ *      after the buffers are sized, and the time per iteration are reported.
+ *      For LxTmix, the fall-backs and the comparisons with the double 
+ *      precision propagation (every cmpE evaluations) are reported too: 
+ *      time, and maximum |logL error| against its bound relTol times the 
+ *      number of cells. Returns 1 if any of the sparse solvers allocates, 
+ *      or if LxTmix is above that bound.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <limits>
+#include <cerrno>
+#include <armadillo>
+#include "Data.h"
+#include "Model.h"
+#include "ProbDistr.h"
+#include "MRW.h"
+#include "Summary.h"
+#include "Chain.h"
+
+using namespace std;
+using namespace arma;
+
+extern "C" void* __libc_malloc(size_t n);
+extern "C" void* __libc_memalign(size_t a, size_t n);
+long nAlloc = 0;
+extern "C" void* malloc(size_t n)
+{
+    nAlloc++;
+    return __libc_malloc(n);
+}
+extern "C" int posix_memalign(void **p, size_t a, size_t n)
+{
+    nAlloc++;
+    *p = __libc_memalign(a,n);
+    return (*p == NULL) ? ENOMEM : 0;
+}
+
+int main(int argc, char** argv)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    const int T = 4;          // Number of time points.
+    int myT[T] = {0,5,15,25}; // Time points; only factors of 5 are allowed.
+    int N = 2;                // Number of promoter states (2 or 3).
+    int maxM = 300;           // Maximum mRNA molecules.
+    double a = 0;             // If N='3S', threshold to define third TS state.
+    char* myDataCode = "Npas4"; // Code for data to load.
+    int nI = 500;             // MRW iterations per solver.
+    double sumPT = 0.01;      // Resolution to define unique parameter sets.
+    int cmpE = 10;            // LxTmix: compare with double precision every cmpE.
+    // Parameters [kON,kOFF,kONs,kOFFs,mu0,mu,muS,d] in basal & stimulus state:
+    vec p0 = {1e-3,0.1,0,0,1e-3,0.1,0,0.0462,
+            0.1,1e-3,0,0,1e-3,1,0,0.0462};
+    // MRW variances (basal & stimulus state):
+    vec z0 = {1e-8,1e-4,0,0,1e-8,1e-4,0,0,
+            1e-4,1e-8,0,0,0,1e-2,0,0};
+    ////////////////////////////////////////////////////////////////////////////
+
+    ModelStruct ms(N,maxM);
+    KronModel km(2,N,maxM);
+    myData x[T], xK[T];
+    vec aK(std::max(N-2,0));
+    aK.fill(a);
+    int nX = 0;     // Sample size.
+    for(int t = 0; t < T; t++)
+    {
+        x[t].loadData(N,maxM,a,myDataCode,myT[t]);
+        xK[t].loadDataK(&km.S,maxM,aK,myDataCode,myT[t]);
+        nX += accu(x[t].data);
+    }
+
+    cout << "Solver allocations(iterations 3-" << nI << ") ms/iteration" << endl;
+    const char* sN[4] = {"LxT","LxTit","LxTmix","LxTk"};
+    bool ok = true;
+    for(int k = 0; k < 4; k++)
+    {
+        arma_rng::set_seed(1);
+        mrwPar mrw;
+        for(int j = 0; j < 8; j++)
+        {
+            mrw.pB(j) = p0(j);
+            mrw.pS(j) = p0(j+8);
+            mrw.zigB(j) = z0(j);
+            mrw.zigS(j) = z0(j+8);
+        }
+        mrwSummary sum(T,sumPT,nI);
+        mrwICs ics(accu(mrw.zigB>0)+accu(mrw.zigS>0),nX);
+        ofstream outP("/dev/null"), outL("/dev/null"), outU("/dev/null");
+        outP.precision(6);
+        outL.precision(6);
+        outU.precision(numeric_limits<double>::max_digits10);
+        mrwChain ch(&ms,&km,(k == 3) ? xK : x,T,myT,k == 3,k == 1,k == 2,
+                &mrw,&sum,&ics,0,&outP,&outL,&outU);
+        ch.mp.cmpE = cmpE;
+        ch.first();
+        ch.step(2);     // Sizes the buffers used on first use.
+        long nA0 = nAlloc;
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        for(int i = 3; i <= nI; i++)
+            ch.step(i);
+        double dt = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        long nA = nAlloc - nA0;
+        ch.last(nI);
+        cout << sN[k] << ' ' << nA << ' ' << (1e3*dt)/(nI-2) << endl;
+        if(k > 0 && nA > 0)
+        {
+            cout << "ERROR: " << sN[k] << " allocates in the MRW loop." << endl;
+            ok = false;
+        }
+        if(k == 2)  // Accuracy of the single precision path (see LxTmix).
+        {
+            mixPar *mp = &ch.mp;
+            cout << "  evaluations " << mp->nEval << ", fall-backs " << mp->nFB;
+            cout << ", double only " << mp->nDbl << ", compared " << mp->nCmp << endl;
+            if(mp->nCmp > 0)
+            {
+                cout << "  time mixed/double (ms) " << (1e3*mp->tMix)/mp->nCmp << ' ';
+                cout << (1e3*mp->tDbl)/mp->nCmp << ", max |logL error| " << mp->maxDL;
+                cout << " (bound " << mp->relTol*nX << ")" << endl;
+            }
+            if(mp->maxDL > mp->relTol*nX)
+            {
+                cout << "ERROR: LxTmix is not within relTol of double precision." << endl;
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
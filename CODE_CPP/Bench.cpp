@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * BENCHMARK: Latency & throughput of a running likelihood server.
+ *
+ * Bench : For every batch size, one client sends nRep requests (latency:
+ *      median & 95th percentile per request); then nCl clients send nRep
+ *      requests of the largest batch size at the same time (throughput in
+ *      parameter sets per second). Parameter sets are random log-normal
+ *      perturbations (sd pSd) of p0.
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <armadillo>
+#include "Client.h"
+
+using namespace std;
+using namespace arma;
+
+int main(int argc, char** argv)
+{
+    ////////////////////////////////////////////////////////////////////////////
+    const char* srvPath = (argc > 1) ? argv[1] : "/tmp/bayfish.sock"; // Server.
+    int nRep = 20;            // Requests per batch size (and client).
+    int nCl = 4;              // Concurrent clients.
+    int nB = 4;               // Batch sizes:
+    int bS[4] = {1,8,64,512};
+    double pSd = 0.1;         // Log-normal perturbation of the parameters.
+    // Parameters [kON,kOFF,kONs,kOFFs,mu0,mu,muS,d] in basal & stimulus state:
+    vec p0 = {1e-3,0.1,0,0,1e-3,0.1,0,0.0462,
+            0.1,1e-3,0,0,1e-3,1,0,0.0462};
+    ////////////////////////////////////////////////////////////////////////////
+
+    bfClient c(srvPath);
+    if(c.fd < 0)
+        return 1;
+    cout << "Server: T = " << c.T << ", states = " << c.nS << ", maxM = " << c.maxM << endl;
+    arma_rng::set_seed(1);
+    mat P = repmat(p0,1,bS[nB-1]) % exp(pSd*randn(16,bS[nB-1]));
+
+    // Latency per request:
+    cout << "Batch median(ms) p95(ms) sets/s" << endl;
+    mat L;
+    for(int b = 0; b < nB; b++)
+    {
+        mat Pb = P.cols(0,bS[b]-1);
+        vector<double> dt;
+        for(int r = 0; r < nRep; r++)
+        {
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            if(!c.logL(Pb,&L))
+            {
+                cout << "ERROR: Request failed." << endl;
+                return 1;
+            }
+            dt.push_back(chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+        }
+        sort(dt.begin(),dt.end());
+        double tot = 0;
+        for(int r = 0; r < nRep; r++)
+            tot += dt[r];
+        cout << bS[b] << ' ' << 1e3*dt[nRep/2] << ' ' << 1e3*dt[(95*nRep)/100];
+        cout << ' ' << (bS[b]*nRep)/tot << endl;
+    }
+
+    // Throughput with concurrent clients:
+    vector<thread> th;
+    vector<int> ok(nCl,1);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for(int k = 0; k < nCl; k++)
+    {
+        th.push_back(thread([&,k]()
+        {
+            bfClient ck(srvPath);
+            mat Lk;
+            for(int r = 0; r < nRep && ok[k]; r++)
+                ok[k] = ck.logL(P,&Lk);
+        }));
+    }
+    for(int k = 0; k < nCl; k++)
+        th[k].join();
+    double tot = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    if(count(ok.begin(),ok.end(),0) > 0)
+        cout << "ERROR: Request failed." << endl;
+    cout << nCl << " clients x " << nRep << " requests of " << bS[nB-1] << " sets: ";
+    cout << (nCl*nRep*bS[nB-1])/tot << " sets/s" << endl;
+    return 0;
+}
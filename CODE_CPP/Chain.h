@@ -0,0 +1,199 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * CHAIN: One iteration of the Metropolis Random Walk, with its output.
+ *
+ * Chain : The body of the MRW loop of main.cpp, so that it can be run (and
+ *      checked for heap allocations, see AllocBench.cpp) outside of it.
+ *
+ *  class mrwChain(ModelStruct *ms, KronModel *km, myData *x, int T,
+ *      int *myT, bool kronM, bool itS, bool mixP, mrwPar *mrw,
+ *      mrwSummary *sum, mrwICs *ics, int sumB, ostream *outP, ostream *outL,
+ *      ostream *outU) : Chain of the parameters mrw, with the likelihood
+ *      selected by kronM, mixP and itS (see lxtEval). outP, outL and outU
+ *      are the *_Par.dat, *_logL.dat and *_Uniq.dat files (see main.cpp).
+ *      lxtWork w, wk : Workspaces of ms and km.
+ *      itSolver is : Warm start of the iterative solvers.
+ *      mixPar mp : Mixed-precision settings and counters.
+ *      mat L, Lt : Log-likelihood per time point of the current state and
+ *          of the proposal.
+ *      ParV ptB, ptS : Proposal.
+ *      int iU : Iteration where the current state was accepted.
+ *
+ *      void first() : Evaluate the initial state (iteration 1).
+ *      void step(int i) : Iteration i > 1; the summaries are updated after
+ *          sumB iterations. It does not allocate memory, except with the
+ *          dense solver (LxT).
+ *      void last(int i) : Write the current state to outU, as the last
+ *          state of a chain of i iterations.
+ *
+ */
+
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include <iostream>
+#include <armadillo>
+#include "Data.h"
+#include "Model.h"
+#include "ProbDistr.h"
+#include "MRW.h"
+#include "Summary.h"
+
+using namespace std;
+using namespace arma;
+
+class mrwChain
+{
+public:
+    ModelStruct *ms;
+    KronModel *km;
+    myData *x;
+    int T;
+    int *myT;
+    bool kronM, itS, mixP;
+    mrwPar *mrw;
+    mrwSummary *sum;
+    mrwICs *ics;
+    int sumB;
+    ostream *outP, *outL, *outU;
+    lxtWork w, wk;
+    itSolver is;
+    mixPar mp;
+    mat L, Lt;
+    ParV ptB, ptS;
+    int iU;
+
+    mrwChain(ModelStruct *myMs, KronModel *myKm, myData *myX, int myTn, int *myTs, bool myKronM, bool myItS, bool myMixP,
+            mrwPar *myMrw, mrwSummary *mySum, mrwICs *myIcs, int mySumB, ostream *myP, ostream *myL, ostream *myU)
+        : w(myMs,myTn), wk(myKm,myTn)
+    {
+        ms = myMs;
+        km = myKm;
+        x = myX;
+        T = myTn;
+        myT = myTs;
+        kronM = myKronM;
+        itS = myItS;
+        mixP = myMixP;
+        mrw = myMrw;
+        sum = mySum;
+        ics = myIcs;
+        sumB = mySumB;
+        outP = myP;
+        outL = myL;
+        outU = myU;
+        L.zeros(1,T);
+        Lt.zeros(1,T);
+        iU = 1;
+    }
+
+    void first()
+    {
+        (*outP) << 1 << ' ' << "B" << ' ';
+        mrw->pB.raw_print(*outP);
+        (*outP) << 1 << ' ' << "S" << ' ';
+        mrw->pS.raw_print(*outP);
+        Par qB = mrw->MatToPar(mrw->pB);
+        Par qS = mrw->MatToPar(mrw->pS);
+        if(kronM)
+        {
+            LxTk(km,x,qB,qS,T,myT,&is,&wk);
+            L = wk.L;
+            is.accept();
+        }
+        else if(itS || mixP)    // Also caches the stationary distribution of the current state.
+        {
+            LxTit(ms,x,qB,qS,T,myT,&is,&w);
+            L = w.L;
+            is.accept();
+        }
+        else
+        {
+            LxT(ms,x,qB,qS,T,myT,&w);
+            L = w.L;
+        }
+        (*outL) << 1 << ' ';
+        L.raw_print(*outL);
+        ics->best(accu(L),mrw->pB,mrw->pS);
+        iU = 1;
+    }
+
+    void step(int i)
+    {
+        mrw->ptB(&ptB);
+        mrw->ptS(ptB,&ptS);
+        if(mrw->inBounds(ptB,ptS))
+        {
+            Par qB = mrw->MatToPar(ptB);
+            Par qS = mrw->MatToPar(ptS);
+            if(kronM)
+                LxTk(km,x,qB,qS,T,myT,&is,&wk);
+            else if(mixP)
+                LxTmix(ms,x,qB,qS,T,myT,&is,&mp,&w);
+            else if(itS)
+                LxTit(ms,x,qB,qS,T,myT,&is,&w);
+            else
+                LxT(ms,x,qB,qS,T,myT,&w);
+            Lt = kronM ? wk.L : w.L;
+            ics->best(accu(Lt),ptB,ptS);
+
+            // If proposal is accepted, update system:
+            double r = as_scalar(randu(1,1));
+            if(r <= exp(accu(Lt)-accu(L)))
+            {
+                (*outU) << iU << ' ' << (i-iU);
+                printRow(*outU,L);
+                printRow(*outU,mrw->pB);
+                printRow(*outU,mrw->pS);
+                (*outU) << endl;
+                iU = i;
+                if(i > sumB)
+                    sum->accept();
+                mrw->pB = ptB;
+                mrw->pS = ptS;
+                L = Lt;
+                if(itS || mixP || kronM)
+                    is.accept();
+            }
+        }
+        (*outP) << i << ' ' << "B" << ' ';
+        mrw->pB.raw_print(*outP);
+        (*outP) << i << ' ' << "S" << ' ';
+        mrw->pS.raw_print(*outP);
+        (*outL) << i << ' ';
+        L.raw_print(*outL);
+        if(i > sumB)
+        {
+            sum->add(mrw->pB,mrw->pS,L);
+            ics->add(accu(L));
+        }
+    }
+
+    void last(int i)
+    {
+        (*outU) << iU << ' ' << (i+1-iU);
+        printRow(*outU,L);
+        printRow(*outU,mrw->pB);
+        printRow(*outU,mrw->pS);
+        (*outU) << endl;
+    }
+};
+
+#endif /* CHAIN_H */
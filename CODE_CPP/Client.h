@@ -0,0 +1,166 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * CLIENT: Query a likelihood server (see Server.h) from another program.
+ *
+ * Client : Connection to the server; parameter sets are the columns of a
+ *      16 x n matrix, [kON,kOFF,kONs,kOFFs,mu0,mu,muS,d] in basal and then
+ *      in stimulus state, i.e. the order sent over the socket.
+ *
+ *  class bfClient(const char* myPath) : Connect to the server listening on
+ *      myPath and ask for its model (srvInfo).
+ *      int fd : Socket (-1 if not connected).
+ *      int T, nS, maxM : Time points, states (i.e. promoter states times
+ *          maxM+1) and maximum mRNA of the model.
+ *      ivec myT : Time points.
+ *      int query(int op, const mat &P, mat *R) : Send a request and write
+ *          the answer in R (one column per parameter set); returns the
+ *          status of the answer, or -1 if the connection failed or P does 
+ *          not have 16 rows (nothing is sent).
+ *      bool logL(const mat &P, mat *L) : Log-likelihood per time point
+ *          (T x n).
+ *      bool dist(const mat &P, mat *D) : Probability distribution per time
+ *          point (nS*T x n; see Server.h).
+ *      bool stop() : Stop the server.
+ *
+ */
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+class bfClient
+{
+public:
+    int fd;
+    int T, nS, maxM;
+    ivec myT;
+
+    bfClient(const char* myPath)
+    {
+        T = 0;
+        nS = 0;
+        maxM = 0;
+        fd = socket(AF_UNIX,SOCK_STREAM,0);
+        sockaddr_un addr;
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path,myPath,sizeof(addr.sun_path)-1);
+        if(fd >= 0 && connect(fd,(sockaddr*) &addr,sizeof(addr)) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        if(fd < 0)
+        {
+            cout << "ERROR: Cannot connect to " << myPath << endl;
+            return;
+        }
+        mat R;
+        if(query(0,mat(16,0),&R) == 0 && R.n_rows >= 3)
+        {
+            T = R(0);
+            nS = R(1);
+            maxM = R(2);
+            myT = conv_to<ivec>::from(R.rows(3,R.n_rows-1));
+        }
+    }
+
+    ~bfClient()
+    {
+        if(fd >= 0)
+            close(fd);
+    }
+
+    bool readAll(void *b, size_t n)
+    {
+        char *c = (char*) b;
+        while(n > 0)
+        {
+            ssize_t r = read(fd,c,n);
+            if(r < 0 && errno == EINTR)
+                continue;
+            if(r <= 0)
+                return false;
+            c += r;
+            n -= r;
+        }
+        return true;
+    }
+
+    bool writeAll(const void *b, size_t n)
+    {
+        const char *c = (const char*) b;
+        while(n > 0)
+        {
+            ssize_t r = send(fd,c,n,MSG_NOSIGNAL);
+            if(r < 0 && errno == EINTR)
+                continue;
+            if(r <= 0)
+                return false;
+            c += r;
+            n -= r;
+        }
+        return true;
+    }
+
+    int query(int op, const mat &P, mat *R)
+    {
+        if(fd < 0 || P.n_rows != 16)
+            return -1;
+        uint32_t h[4] = {0x48534642,(uint32_t) op,(uint32_t) P.n_cols,16};
+        if(!writeAll(h,sizeof(h)) || (P.n_elem > 0 && !writeAll(P.memptr(),P.n_elem*sizeof(double))))
+            return -1;
+        if(!readAll(h,sizeof(h)))
+            return -1;
+        R->set_size(h[3],h[2]);
+        if(R->n_elem > 0 && !readAll(R->memptr(),R->n_elem*sizeof(double)))
+            return -1;
+        return h[1];
+    }
+
+    bool logL(const mat &P, mat *L)
+    {
+        return query(1,P,L) == 0;
+    }
+
+    bool dist(const mat &P, mat *D)
+    {
+        return query(2,P,D) == 0;
+    }
+
+    bool stop()
+    {
+        mat R;
+        return query(3,mat(16,0),&R) == 0;
+    }
+};
+
+#endif /* CLIENT_H */
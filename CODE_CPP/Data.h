@@ -40,6 +40,13 @@
  *          double a : If N='3S', threshold to define third TS state (e.g. 10).
  *          char* myDataCode : Code for specific data file (e.g. "Fos").
  *          int t : Time point to load (e.g. 5).
+ *      loadDataK(Mat<int> *S, int maxM, vec a, char* myDataCode, int t) : 
+ *          Read the same file for a general model of K gene copies and M 
+ *          promoter states (see KronModel), where each line lists the K TS 
+ *          intensities followed by the mRNA number. Column p of the data 
+ *          matrix counts cells whose copies occupy the states as in S.row(p).
+ *          Mat<int> *S : Occupation numbers per promoter state (nP x M).
+ *          vec a : Increasing TS thresholds between active states (M-2).
  * 
  */
 
@@ -126,6 +133,53 @@ public:
             }
         }        
     }
+    
+    void loadDataK(Mat<int> *S, int maxM, vec a, char* myDataCode, int t)
+    {
+        int M = S->n_cols;
+        int K = accu(S->row(0));
+        data.zeros(maxM+1,S->n_rows);
+        
+        char myFileName [255];
+        strcpy (myFileName,"myData_");
+        strcat (myFileName,myDataCode);
+        strcat (myFileName,"_t%d_List.txt");
+        sprintf(myFileName,myFileName,t);
+        ifstream inputFile(myFileName);
+        string line;
+        ivec occ(M);
+        while (getline(inputFile, line))
+        {
+            istringstream ss(line);
+            occ.zeros();
+            for(int k = 0; k < K; k++)
+            {
+                double ts;
+                ss >> ts;
+                int j = 0;      // OFF
+                if(ts != 0)     // ON, ONs, ...
+                {
+                    j = 1;
+                    while(j <= M-2 && ts > a(j-1))
+                        j++;
+                }
+                occ(j)++;
+            }
+            int m;
+            ss >> m;
+            for(int p = 0; p < (int)S->n_rows; p++)
+            {
+                bool eq = true;
+                for(int j = 0; j < M && eq; j++)
+                    eq = ((*S)(p,j) == occ(j));
+                if(eq)
+                {
+                    data(m,p)++;
+                    break;
+                }
+            }
+        }
+    }
             
 };
 
@@ -0,0 +1,455 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * HIER: Hierarchical inference of several genes with shared hyperparameters.
+ *
+ * Hier : Blocked Gibbs sampler over genes. Each sweep (1) proposes new
+ *      parameters for every gene (MRW) and evaluates them in parallel, (2)
+ *      proposes a common degradation rate d, evaluated for all genes in
+ *      parallel, and (3) draws the population (log-normal) priors of the
+ *      free parameters from their conditional distributions. Random numbers
+ *      are drawn only by the main thread, so runs are reproducible for any
+ *      number of threads.
+ *
+ *  class hgGene(char* myCode, int myS, int T, double pT, int maxU) : Data and
+ *      MRW state of a gene.
+ *      char code[64] : Code of its data (e.g. "Npas4").
+ *      int s : Model structure of the gene (see hgModel::ms).
+ *      vector<myData> x : Data matrix per time point.
+ *      mrwPar mrw : Current parameters & proposal variances.
+ *      ParV ptB, ptS : Parameters to evaluate.
+ *      mat L, Lt : Log-likelihood per time point of the current state and
+ *          of the parameters evaluated.
+ *      double lp : Log population prior of the current state.
+ *      bool ev : If true, evaluate ptB & ptS in the next evalAll.
+ *      itSolver is : Warm start of the iterative solvers.
+ *      double cost : Time of its last evaluation (s), used to schedule the
+ *          genes with the longest evaluation first.
+ *      mrwSummary sum : Streaming posterior summaries (see Summary.h).
+ *      ofstream U : Unique accepted states, as the *_Uniq.dat file of the 
+ *          single gene mode (see main.cpp); only if open.
+ *      int iU : Iteration where the current state was accepted.
+ *
+ *      void uniq(int i) : The current state is replaced at iteration i; 
+ *          append it to U with its dwell (states replaced within the same 
+ *          sweep were never a state of the chain, and are not written).
+ *
+ *  class hgModel(int myG, char** codes, int* maxMs, int N, double a,
+ *      int myTn, int *myTs, bool itS, bool mixP, int myNThr, double pT,
+ *      int maxU) : Load the data of myG genes; genes with the same maxM
+ *      share one ModelStruct. The table of unique sets of each gene starts 
+ *      with room for maxU sets (e.g. sumW, grown at every checkpoint).
+ *      vector<ModelStruct*> ms : Model structures, one per distinct maxM.
+ *      vector<hgGene*> g : Genes.
+ *      vector<vector<lxtEval*> > e : Evaluators per thread & model structure.
+ *      bool hgD : If true, degradation rate d shared by all genes.
+ *      double d, zigD : Shared degradation rate & its proposal variance.
+ *      bool hgPop : If true, log(p) ~ N(eta,tau2) for every free gene
+ *          parameter p, with flat prior on eta and inverse gamma (a0,b0)
+ *          prior on tau2; otherwise flat priors.
+ *      uvec iF : Position in [pB pS] of the free gene parameters.
+ *      vec eta, tau2 : Population priors (16, only iF are used).
+ *      int nAcc, nAccD : Accepted gene and shared d proposals.
+ *      int it : Iteration of the last sweep (1 after init).
+ *      int sumB : Burn-in iterations; the accepted gene proposals after 
+ *          them are counted in the summary of each gene (as in main.cpp), 
+ *          while the shared d moves are only counted in nAccD.
+ *
+ *      void init(const mrwPar &mrw, mat lB_m, mat lB_M, mat lS_m, mat lS_M) :
+ *          Initialize every gene as mrw.initPar and evaluate it.
+ *      double logPrior(const ParV &pB, const ParV &pS) : Log population
+ *          prior (up to a constant) of a gene.
+ *      void evalAll() : Evaluate the genes with ev = true, in parallel (see 
+ *          parFor in ProbDistr.h), and write Lt.
+ *      void sweep() : One iteration of the blocked Gibbs sampler.
+ *      void writeHyp(ostream &out, int i) : Append the iteration i of the
+ *          shared hyperparameters chain (if i = 0, the header).
+ *      void writeSum(int N, int s) : (Over)write the summary file of every
+ *          gene, "MRW_[code]_N[N]([maxM])_s[s]_HG_Sum.dat".
+ *      void openUniq(int N, int s), void closeUniq() : Open the unique 
+ *          states file of every gene, "MRW_[code]_N[N]([maxM])_s[s]_HG_Uniq.dat", 
+ *          and, at the end of the run, write the last states and close them.
+ *
+ */
+
+#ifndef HIER_H
+#define HIER_H
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <armadillo>
+#include "Data.h"
+#include "Model.h"
+#include "ProbDistr.h"
+#include "MRW.h"
+#include "Summary.h"
+
+using namespace std;
+using namespace arma;
+
+class hgGene
+{
+public:
+    char code[64];
+    int s;
+    vector<myData> x;
+    mrwPar mrw;
+    ParV ptB, ptS;
+    mat L, Lt;
+    double lp;
+    bool ev;
+    itSolver is;
+    double cost;
+    mrwSummary sum;
+    ofstream U;
+    int iU;
+
+    hgGene(char* myCode, int myS, int T, double pT, int maxU) : x(T), sum(T,pT,maxU)
+    {
+        strncpy(code,myCode,63);
+        code[63] = 0;
+        s = myS;
+        L.zeros(1,T);
+        Lt.zeros(1,T);
+        lp = 0;
+        ev = false;
+        cost = 0;
+        iU = 1;
+    }
+
+    void uniq(int i)
+    {
+        if(!U.is_open() || i == iU)
+            return;
+        U << iU << ' ' << (i-iU);
+        printRow(U,L);
+        printRow(U,mrw.pB);
+        printRow(U,mrw.pS);
+        U << endl;
+        iU = i;
+    }
+};
+
+class hgModel
+{
+public:
+    int G, T;
+    int *myT;
+    int nThr;
+    vector<int> mM;
+    vector<ModelStruct*> ms;
+    vector<hgGene*> g;
+    vector<vector<lxtEval*> > e;
+    bool hgD, hgPop;
+    double d, zigD;
+    uvec iF;
+    vec eta, tau2;
+    double a0, b0;
+    int nAcc, nAccD;
+    int it;
+    int sumB;
+
+    hgModel(int myG, char** codes, int* maxMs, int N, double a, int myTn, int *myTs, bool itS, bool mixP, int myNThr, double pT, int maxU)
+    {
+        G = myG;
+        T = myTn;
+        myT = myTs;
+        nThr = myNThr;
+        for(int j = 0; j < G; j++)
+        {
+            int k = find(mM.begin(),mM.end(),maxMs[j]) - mM.begin();
+            if(k == (int) mM.size())
+            {
+                mM.push_back(maxMs[j]);
+                ms.push_back(new ModelStruct(N,maxMs[j]));
+            }
+            g.push_back(new hgGene(codes[j],k,T,pT,maxU));
+            for(int t = 0; t < T; t++)
+                g[j]->x[t].loadData(N,maxMs[j],a,codes[j],myT[t]);
+            // Before the first evaluation, cost ~ size of the model:
+            g[j]->cost = pow((double) ms[k]->S.n_rows,3);
+        }
+        e.resize(nThr);
+        for(int k = 0; k < nThr; k++)
+            for(unsigned int j = 0; j < ms.size(); j++)
+                e[k].push_back(new lxtEval(ms[j],NULL,&g[0]->x[0],T,myT,itS,mixP));
+        hgD = true;
+        hgPop = true;
+        d = 0;
+        zigD = 1e-6;
+        eta.zeros(16);
+        tau2.ones(16);
+        a0 = 1;
+        b0 = 0.1;
+        nAcc = 0;
+        nAccD = 0;
+        it = 1;
+        sumB = 0;
+    }
+
+    ~hgModel()
+    {
+        for(unsigned int k = 0; k < e.size(); k++)
+            for(unsigned int j = 0; j < e[k].size(); j++)
+                delete e[k][j];
+        for(unsigned int j = 0; j < g.size(); j++)
+            delete g[j];
+        for(unsigned int j = 0; j < ms.size(); j++)
+            delete ms[j];
+    }
+
+    void init(const mrwPar &mrw, mat lB_m, mat lB_M, mat lS_m, mat lS_M)
+    {
+        d = mrw.pB(7);
+        iF.set_size(16);
+        int nF = 0;
+        for(int j = 0; j < 16; j++)
+        {
+            double z = (j < 8) ? mrw.zigB(j) : mrw.zigS(j-8);
+            if(z > 0 && !(hgD && (j%8) == 7))
+                iF(nF++) = j;
+        }
+        iF.resize(nF);
+        for(int j = 0; j < G; j++)
+        {
+            g[j]->mrw = mrw;
+            if(hgD)     // d is sampled jointly for all genes.
+            {
+                g[j]->mrw.zigB(7) = 0;
+                g[j]->mrw.zigS(7) = 0;
+            }
+            g[j]->mrw.initPar(lB_m,lB_M,lS_m,lS_M);
+            g[j]->ptB = g[j]->mrw.pB;
+            g[j]->ptS = g[j]->mrw.pS;
+            g[j]->ev = true;
+        }
+        evalAll();
+        for(int a = 0; a < (int) iF.n_elem; a++)
+        {
+            double zm = 0;
+            for(int j = 0; j < G; j++)
+                zm += log(par(g[j]->mrw.pB,g[j]->mrw.pS,iF(a)))/G;
+            eta(iF(a)) = zm;
+        }
+        for(int j = 0; j < G; j++)
+        {
+            g[j]->L = g[j]->Lt;
+            g[j]->lp = logPrior(g[j]->mrw.pB,g[j]->mrw.pS);
+        }
+    }
+
+    double par(const ParV &pB, const ParV &pS, int j)
+    {
+        return (j < 8) ? pB(j) : pS(j-8);
+    }
+
+    double logPrior(const ParV &pB, const ParV &pS)
+    {
+        if(!hgPop)
+            return 0;
+        double lp = 0;
+        for(int a = 0; a < (int) iF.n_elem; a++)
+        {
+            double z = log(par(pB,pS,iF(a)));
+            lp -= (((z - eta(iF(a)))*(z - eta(iF(a))))/(2*tau2(iF(a)))) + z;
+        }
+        return lp;
+    }
+
+    void evalAll()
+    {
+        vector<int> o;
+        for(int j = 0; j < G; j++)
+            if(g[j]->ev)
+                o.push_back(j);
+        // Longest (last measured) evaluations first:
+        sort(o.begin(),o.end(),[this](int a, int b) { return g[a]->cost > g[b]->cost; });
+        parFor(nThr,o.size(),[&](int k, int j)
+        {
+            hgGene *gj = g[o[j]];
+            lxtEval *ek = e[k][gj->s];
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            ek->eval(gj->ptB,gj->ptS,&gj->x[0],&gj->is);
+            gj->Lt = ek->w.L;
+            gj->cost = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            gj->ev = false;
+        });
+    }
+
+    void sweep()
+    {
+        it++;
+        // (1) Gene parameters, given d & the population priors:
+        for(int j = 0; j < G; j++)
+        {
+            g[j]->mrw.ptB(&g[j]->ptB);
+            g[j]->mrw.ptS(g[j]->ptB,&g[j]->ptS);
+            g[j]->ev = g[j]->mrw.inBounds(g[j]->ptB,g[j]->ptS);
+        }
+        vector<bool> ev(G);
+        for(int j = 0; j < G; j++)
+            ev[j] = g[j]->ev;
+        evalAll();
+        for(int j = 0; j < G; j++)
+        {
+            if(!ev[j])
+                continue;
+            double lpt = logPrior(g[j]->ptB,g[j]->ptS);
+            double r = as_scalar(randu(1,1));
+            if(r <= exp(accu(g[j]->Lt) - accu(g[j]->L) + lpt - g[j]->lp))
+            {
+                g[j]->uniq(it);
+                g[j]->mrw.pB = g[j]->ptB;
+                g[j]->mrw.pS = g[j]->ptS;
+                g[j]->L = g[j]->Lt;
+                g[j]->lp = lpt;
+                if(it > sumB)
+                    g[j]->sum.accept();
+                nAcc++;
+            }
+        }
+        // (2) Shared degradation rate, given the gene parameters:
+        if(hgD)
+        {
+            double dt = d + (as_scalar(randn(1,1))*sqrt(zigD));
+            if(dt > 1e-8)
+            {
+                for(int j = 0; j < G; j++)
+                {
+                    g[j]->ptB = g[j]->mrw.pB;
+                    g[j]->ptS = g[j]->mrw.pS;
+                    g[j]->ptB(7) = dt;
+                    g[j]->ptS(7) = dt;
+                    g[j]->ev = true;
+                }
+                evalAll();
+                double dL = 0;
+                for(int j = 0; j < G; j++)
+                    dL += accu(g[j]->Lt) - accu(g[j]->L);
+                double r = as_scalar(randu(1,1));
+                if(r <= exp(dL))
+                {
+                    d = dt;
+                    for(int j = 0; j < G; j++)
+                    {
+                        g[j]->uniq(it);
+                        g[j]->mrw.pB(7) = dt;
+                        g[j]->mrw.pS(7) = dt;
+                        g[j]->L = g[j]->Lt;
+                    }
+                    nAccD++;    // Not a move of the genes (see sum.nAcc).
+                }
+            }
+        }
+        // (3) Population priors, given the gene parameters (conjugate):
+        if(hgPop)
+        {
+            for(int a = 0; a < (int) iF.n_elem; a++)
+            {
+                int k = iF(a);
+                double zm = 0;
+                for(int j = 0; j < G; j++)
+                    zm += log(par(g[j]->mrw.pB,g[j]->mrw.pS,k))/G;
+                eta(k) = zm + (as_scalar(randn(1,1))*sqrt(tau2(k)/G));
+                double ss = 0;
+                for(int j = 0; j < G; j++)
+                {
+                    double z = log(par(g[j]->mrw.pB,g[j]->mrw.pS,k)) - eta(k);
+                    ss += z*z;
+                }
+                tau2(k) = 1/as_scalar(randg(1,1,distr_param(a0 + (G/2.0),1/(b0 + (ss/2)))));
+            }
+            for(int j = 0; j < G; j++)
+                g[j]->lp = logPrior(g[j]->mrw.pB,g[j]->mrw.pS);
+        }
+    }
+
+    void writeHyp(ostream &out, int i)
+    {
+        const char* pN[8] = {"kON","kOFF","kONs","kOFFs","mu0","mu","muS","d"};
+        if(i == 0)
+        {
+            out << "Iteration" << ' ' << "logL" << ' ' << "d";
+            for(int a = 0; a < (int) iF.n_elem; a++)
+            {
+                const char* c = (iF(a) < 8) ? "_B" : "_S";
+                out << ' ' << "eta_" << pN[iF(a)%8] << c;
+                out << ' ' << "tau2_" << pN[iF(a)%8] << c;
+            }
+            out << endl;
+            return;
+        }
+        double sL = 0;
+        for(int j = 0; j < G; j++)
+            sL += accu(g[j]->L);
+        out << i << ' ' << sL << ' ' << d;
+        for(int a = 0; a < (int) iF.n_elem; a++)
+            out << ' ' << eta(iF(a)) << ' ' << tau2(iF(a));
+        out << endl;
+    }
+
+    void writeSum(int N, int s)
+    {
+        char myFile[255];
+        for(int j = 0; j < G; j++)
+        {
+            strcpy (myFile,"MRW_");
+            strcat (myFile,g[j]->code);
+            strcat (myFile,"_N%d(%d)_s%d_HG_Sum.dat");
+            sprintf(myFile,myFile,N,mM[g[j]->s],s);
+            g[j]->sum.write(myFile);
+        }
+    }
+
+    void openUniq(int N, int s)
+    {
+        char myFile[255];
+        for(int j = 0; j < G; j++)
+        {
+            strcpy (myFile,"MRW_");
+            strcat (myFile,g[j]->code);
+            strcat (myFile,"_N%d(%d)_s%d_HG_Uniq.dat");
+            sprintf(myFile,myFile,N,mM[g[j]->s],s);
+            g[j]->U.open(myFile,ios::out);
+            g[j]->U.precision(numeric_limits<double>::max_digits10);  // Exact round trip.
+            g[j]->U << "Iteration" << ' ' << "Dwell" << ' ';
+            for(int t = 0; t < T; t++)
+                g[j]->U << "logL[" << t << "]" << ' ';
+            g[j]->U << "[B:kON...d]" << ' ' << "[S:kON...d]" << endl;
+        }
+    }
+
+    void closeUniq()
+    {
+        for(int j = 0; j < G; j++)
+        {
+            if(!g[j]->U.is_open())
+                continue;
+            g[j]->uniq(it+1);
+            g[j]->U.close();
+        }
+    }
+};
+
+#endif /* HIER_H */
@@ -0,0 +1,329 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * MAP: Find the posterior mode to start the Metropolis Random Walk.
+ *
+ * MAP : Multi-start Nelder-Mead maximization of the log-likelihood (i.e. the
+ *      posterior under the flat priors of the MRW) in log-parameter space,
+ *      and proposal covariance from the Hessian at the mode.
+ *
+ *  class mapPar(const mrwPar &mrw) : Free parameters and optimizer settings.
+ *      ParV pB, pS : Parameters; the fixed values are kept.
+ *      ParV zigS : Proposal variances in stimulus state; parameters with
+ *          zigS = 0 are copied from the basal state.
+ *      uvec iF : Position in [pB pS] of the free parameters (zig > 0).
+ *      int d : Number of free parameters.
+ *      int nmI : Maximum likelihood evaluations per optimization.
+ *      double nmTol : Stop when the logL range of the simplex is below nmTol.
+ *      double nmStep : Initial simplex size (log units).
+ *      double hStep : Finite difference step of the Hessian (log units).
+ *      vec lo, hi : Search box of the free parameters (log units); by
+ *          default the MRW support (p > 1e-8, see mrwPar::inBounds).
+ *      void toPar(const vec &y, ParV *qB, ParV *qS) : Parameters with the
+ *          free ones equal to exp(y).
+ *      void toLog(const ParV &qB, const ParV &qS, vec *y) : Inverse of toPar.
+ *      void setBox(const ParV &lB_m, const ParV &lB_M, const ParV &lS_m,
+ *          const ParV &lS_M) : Restricts the search to the initPar boxes
+ *          (within the MRW support).
+ *      bool inBox(const vec &y) : True if lo <= y <= hi.
+ *
+ *  double mapObj(mapPar *mp, lxtEval *e, const vec &y) : -logL at y, or
+ *      +Inf (without evaluating it) if y is outside the search box.
+ *
+ *  double nelderMead(mapPar *mp, lxtEval *e, vec *y) : Maximizes the
+ *      log-likelihood starting from y (restarting once from the best vertex
+ *      after convergence); the vertices outside the search box are rejected
+ *      (see mapObj). Writes the mode in y and returns its logL.
+ *
+ *  void mapMulti(mapPar *mp, vector<lxtEval*> e, const mat &Y0, mat *Y,
+ *      vec *F) : Runs nelderMead from every column of Y0, in parallel with
+ *      one thread per evaluator (see parFor in ProbDistr.h), and writes the
+ *      modes in Y and their logL in F.
+ *
+ *  void hessLog(mapPar *mp, lxtEval *e, const vec &y, mat *H) : Central
+ *      finite difference Hessian of -logL at y (log units).
+ *
+ *  bool mapProp(mapPar *mp, const vec &y, const mat &H, mrwPar *mrw) : Sets
+ *      the MRW proposal covariance to (2.38^2/d) inv(H), transformed to
+ *      linear parameters at y (mrw->cL, and its diagonal in zigB & zigS).
+ *      Returns false (and leaves mrw unchanged) if H is not positive
+ *      definite.
+ *
+ */
+
+#ifndef MAP_H
+#define MAP_H
+
+#include <iostream>
+#include <vector>
+#include <armadillo>
+#include "Model.h"
+#include "ProbDistr.h"
+#include "MRW.h"
+
+using namespace std;
+using namespace arma;
+
+class mapPar
+{
+public:
+    ParV pB, pS;
+    ParV zigS;
+    uvec iF;
+    int d;
+    int nmI;
+    double nmTol;
+    double nmStep;
+    double hStep;
+    vec lo, hi;
+
+    mapPar(const mrwPar &mrw)
+    {
+        pB = mrw.pB;
+        pS = mrw.pS;
+        zigS = mrw.zigS;
+        iF.set_size(16);
+        d = 0;
+        for(int j = 0; j < 8; j++)
+            if(mrw.zigB(j) > 0)
+                iF(d++) = j;
+        for(int j = 0; j < 8; j++)
+            if(mrw.zigS(j) > 0)
+                iF(d++) = j+8;
+        iF.resize(d);
+        nmI = 2000;
+        nmTol = 1e-4;
+        nmStep = 0.5;
+        hStep = 0.01;
+        lo.set_size(d);
+        lo.fill(log(1e-8));
+        hi.set_size(d);
+        hi.fill(datum::inf);
+    }
+
+    void toPar(const vec &y, ParV *qB, ParV *qS)
+    {
+        (*qB) = pB;
+        (*qS) = pS;
+        for(int a = 0; a < d; a++)
+        {
+            if(iF(a) < 8)
+                (*qB)(iF(a)) = exp(y(a));
+            else
+                (*qS)(iF(a)-8) = exp(y(a));
+        }
+        for(int j = 0; j < 8; j++)
+            if(zigS(j) == 0)
+                (*qS)(j) = (*qB)(j);
+    }
+
+    void toLog(const ParV &qB, const ParV &qS, vec *y)
+    {
+        y->set_size(d);
+        for(int a = 0; a < d; a++)
+            (*y)(a) = log((iF(a) < 8) ? qB(iF(a)) : qS(iF(a)-8));
+    }
+
+    void setBox(const ParV &lB_m, const ParV &lB_M, const ParV &lS_m, const ParV &lS_M)
+    {
+        vec m, M;
+        toLog(lB_m,lS_m,&m);
+        toLog(lB_M,lS_M,&M);
+        for(int a = 0; a < d; a++)
+        {
+            if(M(a) > m(a))     // Parameters without a box keep the MRW support.
+            {
+                lo(a) = std::max(lo(a),m(a));
+                hi(a) = M(a);
+            }
+        }
+    }
+
+    bool inBox(const vec &y)
+    {
+        return all(y >= lo) && all(y <= hi);
+    }
+};
+
+double mapObj(mapPar *mp, lxtEval *e, const vec &y)
+{
+    if(!mp->inBox(y))
+        return datum::inf;
+    ParV qB, qS;
+    mp->toPar(y,&qB,&qS);
+    return -e->eval(qB,qS);
+}
+
+double nelderMead(mapPar *mp, lxtEval *e, vec *y)
+{
+    int d = mp->d;
+    mat S(d,d+1);   // Simplex vertices.
+    vec f(d+1);     // -logL at the vertices.
+    vec c(d), yr(d), ye(d), yc(d);
+    int nE = 0;
+    for(int r = 0; r < 2; r++)  // Restart once from the best vertex.
+    {
+        for(int k = 0; k <= d; k++)
+        {
+            S.col(k) = (*y);
+            if(k > 0)
+                S(k-1,k) += mp->nmStep;
+            f(k) = mapObj(mp,e,S.col(k));
+            nE++;
+        }
+        while(nE < mp->nmI)
+        {
+            uvec o = sort_index(f);
+            S = S.cols(o);
+            f = f.elem(o);
+            if((f(d)-f(0)) < mp->nmTol)
+                break;
+            c = mean(S.cols(0,d-1),1);
+            // Reflection:
+            yr = c + (c-S.col(d));
+            double fr = mapObj(mp,e,yr);
+            nE++;
+            if(fr < f(0))
+            {
+                // Expansion:
+                ye = c + 2*(c-S.col(d));
+                double fe = mapObj(mp,e,ye);
+                nE++;
+                if(fe < fr)
+                {
+                    S.col(d) = ye;
+                    f(d) = fe;
+                }
+                else
+                {
+                    S.col(d) = yr;
+                    f(d) = fr;
+                }
+            }
+            else if(fr < f(d-1))
+            {
+                S.col(d) = yr;
+                f(d) = fr;
+            }
+            else
+            {
+                // Contraction (outside if the reflection improved the worst):
+                if(fr < f(d))
+                    yc = c + 0.5*(yr-c);
+                else
+                    yc = c + 0.5*(S.col(d)-c);
+                double fc = mapObj(mp,e,yc);
+                nE++;
+                if(fc < std::min(fr,f(d)))
+                {
+                    S.col(d) = yc;
+                    f(d) = fc;
+                }
+                else
+                {
+                    // Shrink towards the best vertex:
+                    for(int k = 1; k <= d; k++)
+                    {
+                        S.col(k) = S.col(0) + 0.5*(S.col(k)-S.col(0));
+                        f(k) = mapObj(mp,e,S.col(k));
+                        nE++;
+                    }
+                }
+            }
+        }
+        (*y) = S.col(f.index_min());
+    }
+    return -f.min();
+}
+
+void mapMulti(mapPar *mp, vector<lxtEval*> e, const mat &Y0, mat *Y, vec *F)
+{
+    Y->set_size(mp->d,Y0.n_cols);
+    F->set_size(Y0.n_cols);
+    parFor(e.size(),Y0.n_cols,[&](int k, int j)
+    {
+        vec y = Y0.col(j);
+        (*F)(j) = nelderMead(mp,e[k],&y);
+        Y->col(j) = y;
+    });
+}
+
+void hessLog(mapPar *mp, lxtEval *e, const vec &y, mat *H)
+{
+    int d = mp->d;
+    double h = mp->hStep;
+    ParV qB, qS;
+    vec z = y;
+    H->set_size(d,d);
+    mp->toPar(z,&qB,&qS);
+    double f0 = -e->eval(qB,qS);
+    for(int a = 0; a < d; a++)
+    {
+        z(a) = y(a) + h;
+        mp->toPar(z,&qB,&qS);
+        double fp = -e->eval(qB,qS);
+        z(a) = y(a) - h;
+        mp->toPar(z,&qB,&qS);
+        double fm = -e->eval(qB,qS);
+        z(a) = y(a);
+        (*H)(a,a) = (fp - (2*f0) + fm)/(h*h);
+        for(int b = 0; b < a; b++)
+        {
+            double fs[4];
+            for(int s = 0; s < 4; s++)
+            {
+                z(a) = y(a) + ((s < 2) ? h : -h);
+                z(b) = y(b) + (((s%2) == 0) ? h : -h);
+                mp->toPar(z,&qB,&qS);
+                fs[s] = -e->eval(qB,qS);
+            }
+            z(a) = y(a);
+            z(b) = y(b);
+            (*H)(a,b) = (fs[0] - fs[1] - fs[2] + fs[3])/(4*h*h);
+            (*H)(b,a) = (*H)(a,b);
+        }
+    }
+}
+
+bool mapProp(mapPar *mp, const vec &y, const mat &H, mrwPar *mrw)
+{
+    int d = mp->d;
+    mat Hi;
+    if(!inv_sympd(Hi,H))
+        return false;
+    // Covariance of the linear parameters, i.e. dx = x*dy:
+    vec x = exp(y);
+    mat C = (2.38*2.38/d)*(Hi%(x*x.t()));
+    mat Lf;
+    if(!chol(Lf,C,"lower"))
+        return false;
+    mrw->cL.zeros(16,16);
+    for(int a = 0; a < d; a++)
+    {
+        for(int b = 0; b <= a; b++)
+            mrw->cL(mp->iF(a),mp->iF(b)) = Lf(a,b);
+        if(mp->iF(a) < 8)
+            mrw->zigB(mp->iF(a)) = C(a,a);
+        else
+            mrw->zigS(mp->iF(a)-8) = C(a,a);
+    }
+    return true;
+}
+
+#endif /* MAP_H */
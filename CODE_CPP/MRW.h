@@ -27,14 +27,18 @@
  * MRW : My Metropolis Random Walk (MRW) algorithm.
  * 
  *  class mrwPar : Structure to follow the MRW progress.
- *      mat zigB : Variance for parameter proposals in basal state.
- *      mat zigS : Variance for parameter proposals in stimulus state.
- *      mat pB : Current parameters in basal state.
- *      mat pS : Current parameters in stimulus state.
+ *      ParV zigB : Variance for parameter proposals in basal state.
+ *      ParV zigS : Variance for parameter proposals in stimulus state.
+ *      ParV pB : Current parameters in basal state.
+ *      ParV pS : Current parameters in stimulus state.
+ *      mat cL : If not empty, lower Cholesky factor (16 x 16) of the joint 
+ *          proposal covariance of [pB pS] (e.g. from the Hessian at the 
+ *          posterior mode, see MAP.h); otherwise proposals are independent 
+ *          with variances zigB and zigS.
  * 
  *      mat ParToMat(Par p) : Translates a Par structure to a vector.
  * 
- *      Par MatToPar(mat m) : Translates a vector to a Par structure.
+ *      Par MatToPar(const mat &m) : Translates a vector to a Par structure.
  * 
  *      void initPar(mat lB_m, mat lB_M, mat lS_m, mat lS_M) : Initialize 
  *          parameters to be fitted in the MRW by choosing a uniformly 
@@ -42,13 +46,17 @@
  *          the parameter does not change with stimulus, the ptB value is 
  *          copied.
  * 
- *      mat ptB() : Calculates the next proposal parameters in basal state to be 
- *          evaluated by the Metropolis algorithm.
+ *      void ptB(ParV *pt) : Calculates the next proposal parameters in basal 
+ *          state to be evaluated by the Metropolis algorithm. With cL, the 
+ *          correlated step in stimulus state is drawn too (dS).
  * 
- *      mat ptS(mat ptB) : Calculates the next proposal parameters in stimulus 
- *          state to be evaluated by the Metropolis algorithm. Notice that when 
- *          the parameter does not change with stimulus, the ptB value is 
- *          copied.
+ *      void ptS(const ParV &ptB, ParV *pt) : Calculates the next proposal 
+ *          parameters in stimulus state to be evaluated by the Metropolis 
+ *          algorithm. Notice that when the parameter does not change with 
+ *          stimulus, the ptB value is copied.
+ * 
+ *      bool inBounds(const ParV &ptB, const ParV &ptS) : True if all the 
+ *          non-zero parameters of the proposal are positive (i.e. > 1e-8).
  */
 
 #ifndef MRW_H
@@ -66,10 +74,13 @@ using namespace arma;
 class mrwPar
 {
 public:
-    mat zigB;
-    mat zigS;
-    mat pB;
-    mat pS;
+    ParV zigB;
+    ParV zigS;
+    ParV pB;
+    ParV pS;
+    mat cL;
+    ParV dS;
+    vec::fixed<16> z;
     
     mrwPar() { }
     
@@ -88,7 +99,7 @@ public:
        return temp;
     }
     
-    Par MatToPar(mat m)
+    Par MatToPar(const mat &m)
     {
        Par temp;
        temp.kON = m(0);
@@ -109,18 +120,43 @@ public:
         pS = ((zigS==0)%pB) + ((zigS>0)%(lS_m+(randu(size(pB))%(lS_M-lS_m))));
     }
     
-    mat ptB()
+    void ptB(ParV *pt)
     {
-        mat pt;
-        pt = pB + (randn(size(pB))%sqrt(zigB));
-        return pt;
+        if(cL.n_elem == 0)
+        {
+            (*pt) = pB + (randn(size(pB))%sqrt(zigB));
+            return;
+        }
+        z.randn();
+        for(int j = 0; j < 8; j++)
+        {
+            double sB = 0;
+            double sS = 0;
+            for(int k = 0; k <= j; k++)
+                sB += cL(j,k)*z(k);
+            for(int k = 0; k <= (j+8); k++)
+                sS += cL(j+8,k)*z(k);
+            (*pt)(j) = pB(j) + sB;
+            dS(j) = sS;
+        }
     }    
     
-    mat ptS(mat ptB)
+    void ptS(const ParV &ptB, ParV *pt)
+    {
+        if(cL.n_elem == 0)
+            (*pt) = ((zigS==0)%ptB) + ((zigS>0)%pS) + (randn(size(pS))%sqrt(zigS));
+        else
+            (*pt) = ((zigS==0)%ptB) + ((zigS>0)%(pS+dS));
+    }
+    
+    bool inBounds(const ParV &ptB, const ParV &ptS)
     {
-        mat pt;
-        pt = ((zigS==0)%ptB) + ((zigS>0)%pS) + (randn(size(pS))%sqrt(zigS));
-        return pt;
+        for(int j = 0; j < 8; j++)
+        {
+            if((pB(j) != 0 && ptB(j) <= 1e-8) || (pS(j) != 0 && ptS(j) <= 1e-8))
+                return false;
+        }
+        return true;
     }
 };
 
@@ -34,6 +34,9 @@
  *      double muS   : mRNA synthesis rate of promoter in ONs state 
  *      double d     : mRNA degradation rate 
  * 
+ *  ParV : Fixed-size vector (no heap memory) with the Par values, i.e. 
+ *      [kON,kOFF,kONs,kOFFs,mu0,mu,muS,d].
+ * 
  *  class ModelStruct(int myN, int myMaxM) : Create instructions to construct 
  *      the transition matrix under the given model (N = myN) and maximum 
  *      number of mRNA molecules (maxM = myMaxM).
@@ -42,12 +45,65 @@
  *          [#ON promoters, #ONs promoters, #mRNA molecules] if N=3.
  *      mat R : Lists the positions of the transition matrix with 
  *          propensities different from zero and the kind of reaction occuring.
+ *      umat loc : Positions of the transition matrix listed in R, i.e. 
+ *          [row;col] per reaction, to build the sparse transition matrix.
+ *      sp_mat spA : Sparse pattern of the transition matrix.
+ *      uvec spI : Index in R of each non-zero value of spA.
  *      int N : Model family, i.e. number of states (e.g. 2).
  *      int maxM : Maximum mRNA number to consider (e.g. 300).
  * 
+ *      vec Rates(Par p) : Given the input parameters, returns the value of 
+ *          each position of the transition matrix listed in R.
+ * 
  *      mat TransM(Par p) : Given the input parameters and previously defined N 
  *          and maxM, returns the transition matrix for the model.
  * 
+ *      sp_mat TransMsp(Par p) : As TransM, but returns a sparse matrix.
+ * 
+ *      Rates(const Par &p, vec *v), TransM(const Par &p, mat *A, vec *v), 
+ *          TransMsp(const Par &p, sp_mat *A, vec *v) : As above, but write 
+ *          in previously allocated v and A (A must have the pattern spA for 
+ *          TransMsp), i.e. without allocating memory.
+ * 
+ *  class genOp : Transition matrix applied without building it (see the 
+ *      iterative solvers in ProbDistr.h): size(), apply(x,y) (y = A*x), 
+ *      tri(lo,di,up) (tridiagonal part) and maxRate() (max |A(i,i)|).
+ *  class spGen : genOp with a sparse matrix A (e.g. ModelStruct::TransMsp).
+ *  class spGenF : genOp with the values of a spGen S in single precision 
+ *      (and 32-bit row indices), i.e. half the memory traffic per product; 
+ *      the diagonal is kept in double precision and the products are 
+ *      accumulated in double precision. load(S) copies the values of S.
+ *  class kronGen : genOp of the general model, factored as the promoter 
+ *      transitions G (nP x nP) plus the mRNA synthesis (muP per promoter 
+ *      state) and degradation (d) within each promoter state.
+ * 
+ *  class KronModel(int myK, int myM, int myMaxM, vec myKX, Mat<int> myE) : 
+ *      General model of myK gene copies with myM promoter states each and 
+ *      maxM = myMaxM; the promoter states of the cell are the occupation 
+ *      numbers of the myM states, ordered as in the 2S & 3S ModelStruct. 
+ *      The rates of Par are theta(0..7) and the fixed rates myKX are 
+ *      theta(8+k). myE lists the promoter transitions of one copy, 
+ *      [from,to,rate index], with rate indexes 0-3 (kON...kOFFs) or 8+k; if 
+ *      empty, the chain OFF <-> ON <-> ONs <-> S3 <-> ... with myKX = 
+ *      [kUP3, kDOWN3, ..., kUP(M-1), kDOWN(M-1), mu3, ..., mu(M-1)] (3*(M-3) 
+ *      values). In both cases the last M-3 values of myKX are the synthesis 
+ *      rates of states >= 3.
+ *      Mat<int> S : Occupation numbers of each promoter state (nP x M).
+ *      Mat<int> E : Promoter transitions of one copy, [from,to,rate index].
+ *      vec kX : Fixed rates.
+ *      bool ok : False if myKX or myE were not valid (the wrong rates are 
+ *          set to 0, and the wrong transitions dropped).
+ *      ivec iMu : Index of the synthesis rate of each state; int iD : of d.
+ *      sp_mat G0 : Pattern of G; uvec eP, eC, eK & vec eS : CSC position, 
+ *          column, rate index and number of copies of every transition; 
+ *          uvec dP : CSC position of each diagonal value.
+ *      void addRate(int from, int to, int k) : Add a transition (rate 
+ *          theta(k)) and rebuild the pattern.
+ *      int index(const int *occ) : Promoter state with occupation numbers occ.
+ *      void TransMk(const vec &theta, kronGen *A), TransMk(const Par &p, 
+ *          kronGen *A) : Write the factored transition matrix in A; after 
+ *          the first call only the values of G change (no memory allocated).
+ * 
  */
 
 #ifndef MODEL_H
@@ -56,6 +112,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
 #include <armadillo>
 
 using namespace std;
@@ -82,11 +139,17 @@ public:
     }
 };
 
+// Par as a fixed-size vector [kON,kOFF,kONs,kOFFs,mu0,mu,muS,d]:
+typedef rowvec::fixed<8> ParV;
+
 class ModelStruct
 {
 public:
     Mat<int> S;
     mat R;
+    umat loc;
+    sp_mat spA;
+    uvec spI;
     int N;
     int maxM;
     
@@ -108,19 +171,75 @@ public:
         {
             cout << "ERROR: Model non defined." << endl;
         }
+        loc.set_size(2,R.n_rows);
+        for(int i = 0; i < R.n_rows; i++)
+        {
+            loc(0,i) = R(i,1);
+            loc(1,i) = R(i,2);
+        }
+        // Sparse pattern; each non-zero keeps its index in R:
+        vec temp = linspace<vec>(1,R.n_rows,R.n_rows);
+        spA = sp_mat(loc,temp,S.n_rows,S.n_rows,true,false);
+        spI.set_size(spA.n_nonzero);
+        for(uword k = 0; k < spA.n_nonzero; k++)
+        {
+            spI(k) = (uword) spA.values[k] - 1;
+        }
     }
     
-    mat TransM(Par p)
+    void Rates(const Par &p, vec *v)
     {
-        mat A;
+        v->set_size(R.n_rows);
         if(N==2)
         {
-            A = transM_2S(p.kON, p.kOFF, p.mu0, p.mu, p.d);
+            rates_2S(p.kON, p.kOFF, p.mu0, p.mu, p.d, v);
         }
         else if(N==3)
         {
-            A = transM_3S(p.kON, p.kOFF, p.kONs, p.kOFFs, p.mu0, p.mu, p.muS, p.d);
+            rates_3S(p.kON, p.kOFF, p.kONs, p.kOFFs, p.mu0, p.mu, p.muS, p.d, v);
+        }
+    }
+    
+    vec Rates(Par p)
+    {
+        vec v;
+        Rates(p,&v);
+        return v;
+    }
+    
+    void TransM(const Par &p, mat *A, vec *v)
+    {
+        Rates(p,v);
+        A->zeros(S.n_rows,S.n_rows);
+        for(int i = 0; i < R.n_rows; i++)
+        {
+            (*A)(loc(0,i),loc(1,i)) = (*v)(i);
         }
+    }
+    
+    mat TransM(Par p)
+    {
+        mat A;
+        vec v;
+        TransM(p,&A,&v);
+        return A;
+    }
+    
+    void TransMsp(const Par &p, sp_mat *A, vec *v)
+    {
+        Rates(p,v);
+        double *a = access::rwp(A->values);
+        for(uword k = 0; k < A->n_nonzero; k++)
+        {
+            a[k] = (*v)(spI(k));
+        }
+    }
+    
+    sp_mat TransMsp(Par p)
+    {
+        sp_mat A = spA;
+        vec v;
+        TransMsp(p,&A,&v);
         return A;
     }
     
@@ -188,17 +307,15 @@ public:
         }
     }
 
-    mat transM_2S(double kON, double kOFF, double mu0, double mu, double d)
+    void rates_2S(double kON, double kOFF, double mu0, double mu, double d, vec *v)
     {
-        mat A(S.n_rows,S.n_rows,fill::zeros);
-        int row,col;
+        int col;
         for(int i = 0; i < R.n_rows; i++)
         {
-            row = R(i,1);
             col = R(i,2);
             if(R(i,0)==0)       // Diagonal, i.e. all negative
             {
-                A(row,col) = -(kON*(2-S(col,0)))  // Promoter activation
+                (*v)(i) = -(kON*(2-S(col,0)))  // Promoter activation
                         -(kOFF*S(col,0))      // Promoter deactivation
                         -(mu0*(2-S(col,0)))   // mRNA synthesis from OFF promoters
                         -(mu*S(col,0))        // mRNA synthesis from ON promoters
@@ -206,21 +323,21 @@ public:
             }
             else if(R(i,0)==1)   // Promoter activation
             {
-                A(row,col) = kON*(2-S(col,0));
+                (*v)(i) = kON*(2-S(col,0));
             }
             else if(R(i,0)==2)   // Promoter deactivation
             {
-                A(row,col) = kOFF*S(col,0);
+                (*v)(i) = kOFF*S(col,0);
             }
             else if(R(i,0)==3)   // mRNA synthesis
             {
-                A(row,col) = mu0*(2-S(col,0)) + mu*S(col,0);
+                (*v)(i) = mu0*(2-S(col,0)) + mu*S(col,0);
             }
+            else if(R(i,0)==4)   // mRNA degradation
             {
-                A(row,col) = d*S(col,1);
+                (*v)(i) = d*S(col,1);
             }
         }
-        return A;
     }
     
     void species3S()
@@ -293,17 +410,15 @@ public:
         }
     }
     
-    mat transM_3S(double kON, double kOFF, double kONs, double kOFFs, double mu0, double mu, double muS, double d)
+    void rates_3S(double kON, double kOFF, double kONs, double kOFFs, double mu0, double mu, double muS, double d, vec *v)
     {
-        mat A(S.n_rows,S.n_rows,fill::zeros);
-        int row,col;
+        int col;
         for(int i = 0; i < R.n_rows; i++)
         {
-            row = R(i,1);
             col = R(i,2);
             if(R(i,0)==0)       // Diagonal, i.e. all negative
             {
-                A(row,col) = -(kON*(2-S(col,0)-S(col,1))) // Promoter activation (OFF->ON)
+                (*v)(i) = -(kON*(2-S(col,0)-S(col,1))) // Promoter activation (OFF->ON)
                         -(kOFF*S(col,0))      // Promoter deactivation (ON->OFF)
                         -(kONs*S(col,0))      // Promoter super-activation (ON->ONs)
                         -(kOFFs*S(col,1))     // Promoter super-deactivation (ONs->ON)
@@ -314,31 +429,478 @@ public:
             }
             else if(R(i,0)==1)   // Promoter activation (OFF->ON)
             {
-                A(row,col) = kON*(2-S(col,0)-S(col,1));
+                (*v)(i) = kON*(2-S(col,0)-S(col,1));
             }
             else if(R(i,0)==2)   // Promoter deactivation (ON->OFF)
             {
-                A(row,col) = kOFF*S(col,0);
+                (*v)(i) = kOFF*S(col,0);
             }
             else if(R(i,0)==3)   // Promoter super-activation (ON->ONs)
             {
-                A(row,col) = kONs*S(col,0);
+                (*v)(i) = kONs*S(col,0);
             }
             else if(R(i,0)==4)   // Promoter super-deactivation (ONs->ON)
             {
-                A(row,col) = kOFFs*S(col,1);
+                (*v)(i) = kOFFs*S(col,1);
             }
             else if(R(i,0)==5)   // mRNA synthesis
             {
-                A(row,col) = mu0*(2-S(col,0)-S(col,1)) + mu*S(col,0) 
+                (*v)(i) = mu0*(2-S(col,0)-S(col,1)) + mu*S(col,0) 
                         + muS*S(col,1);
             }
             else if(R(i,0)==6)   // mRNA degradation
             {
-                A(row,col) = d*S(col,2);
+                (*v)(i) = d*S(col,2);
             }
         }
-        return A;
+    }
+};
+
+class genOp
+{
+public:
+    virtual ~genOp() { }
+    virtual int size() = 0;
+    virtual void apply(const double *x, double *y) = 0;
+    virtual void tri(vec *lo, vec *di, vec *up) = 0;
+    virtual double maxRate() = 0;
+};
+
+class spGen : public genOp
+{
+public:
+    sp_mat A;
+    
+    int size()
+    {
+        return A.n_rows;
+    }
+    
+    void apply(const double *x, double *y)
+    {
+        const uword *ci = A.col_ptrs;
+        const uword *ri = A.row_indices;
+        const double *va = A.values;
+        for(uword i = 0; i < A.n_rows; i++)
+            y[i] = 0;
+        for(uword c = 0; c < A.n_cols; c++)
+        {
+            double xc = x[c];
+            if(xc == 0)
+                continue;
+            for(uword k = ci[c]; k < ci[c+1]; k++)
+                y[ri[k]] += va[k]*xc;
+        }
+    }
+    
+    void tri(vec *lo, vec *di, vec *up)
+    {
+        const uword *ci = A.col_ptrs;
+        const uword *ri = A.row_indices;
+        const double *va = A.values;
+        lo->zeros();
+        di->zeros();
+        up->zeros();
+        for(uword c = 0; c < A.n_cols; c++)
+        {
+            for(uword k = ci[c]; k < ci[c+1]; k++)
+            {
+                uword r = ri[k];
+                if(r==c)
+                    (*di)(r) = va[k];
+                else if(r==(c+1))
+                    (*lo)(r) = va[k];
+                else if(c==(r+1))
+                    (*up)(r) = va[k];
+            }
+        }
+    }
+    
+    double maxRate()
+    {
+        const uword *ci = A.col_ptrs;
+        const uword *ri = A.row_indices;
+        const double *va = A.values;
+        double q = 0;
+        for(uword c = 0; c < A.n_cols; c++)
+            for(uword k = ci[c]; k < ci[c+1]; k++)
+                if(ri[k] == c)
+                    q = std::max(q,-va[k]);
+        return q;
+    }
+};
+
+class spGenF : public genOp
+{
+public:
+    spGen *S;
+    fvec fv;        // Off-diagonal values (0 on the diagonal).
+    Col<u32> fr;    // Row indices.
+    vec dv;         // Diagonal.
+    
+    spGenF()
+    {
+        S = NULL;
+    }
+    
+    void load(spGen *myS)
+    {
+        S = myS;
+        const sp_mat &A = S->A;
+        const uword *ci = A.col_ptrs;
+        const uword *ri = A.row_indices;
+        const double *va = A.values;
+        if(fv.n_elem != A.n_nonzero)    // Only on first use.
+        {
+            fv.set_size(A.n_nonzero);
+            fr.set_size(A.n_nonzero);
+        }
+        dv.zeros(A.n_rows);
+        for(uword c = 0; c < A.n_cols; c++)
+        {
+            for(uword k = ci[c]; k < ci[c+1]; k++)
+            {
+                fr(k) = ri[k];
+                fv(k) = (ri[k] == c) ? 0 : (float) va[k];
+                if(ri[k] == c)
+                    dv(c) = va[k];
+            }
+        }
+    }
+    
+    int size()
+    {
+        return S->size();
+    }
+    
+    void apply(const double *x, double *y)
+    {
+        const uword *ci = S->A.col_ptrs;
+        const u32 *ri = fr.memptr();
+        const float *va = fv.memptr();
+        const double *di = dv.memptr();
+        uword n = dv.n_elem;
+        for(uword i = 0; i < n; i++)
+            y[i] = di[i]*x[i];
+        for(uword c = 0; c < n; c++)
+        {
+            double xc = x[c];
+            if(xc == 0)
+                continue;
+            for(uword k = ci[c]; k < ci[c+1]; k++)
+                y[ri[k]] += va[k]*xc;
+        }
+    }
+    
+    void tri(vec *lo, vec *di, vec *up)
+    {
+        S->tri(lo,di,up);
+    }
+    
+    double maxRate()
+    {
+        return S->maxRate();
+    }
+};
+
+class kronGen : public genOp
+{
+public:
+    int nP;
+    int maxM;
+    sp_mat G;
+    vec muP;
+    double d;
+    vec th;     // Rates, [ParV kX] (see KronModel).
+    
+    int size()
+    {
+        return nP*(maxM+1);
+    }
+    
+    void apply(const double *x, double *y)
+    {
+        int M1 = maxM+1;
+        for(int i = 0; i < nP*M1; i++)
+            y[i] = 0;
+        // Promoter transitions, Y = X*G' with X(m,p):
+        const uword *ci = G.col_ptrs;
+        const uword *ri = G.row_indices;
+        const double *va = G.values;
+        for(int c = 0; c < nP; c++)
+        {
+            const double *xc = x + (c*M1);
+            for(uword k = ci[c]; k < ci[c+1]; k++)
+            {
+                double g = va[k];
+                double *yr = y + (ri[k]*M1);
+                for(int m = 0; m < M1; m++)
+                    yr[m] += g*xc[m];
+            }
+        }
+        // mRNA synthesis & degradation within each promoter state:
+        for(int p = 0; p < nP; p++)
+        {
+            const double *xp = x + (p*M1);
+            double *yp = y + (p*M1);
+            double b = muP(p);
+            for(int m = 0; m < M1; m++)
+                yp[m] -= (b + (d*m))*xp[m];
+            for(int m = 1; m < M1; m++)
+                yp[m] += b*xp[m-1];
+            for(int m = 0; m < maxM; m++)
+                yp[m] += d*(m+1)*xp[m+1];
+        }
+    }
+    
+    void tri(vec *lo, vec *di, vec *up)
+    {
+        int M1 = maxM+1;
+        for(int p = 0; p < nP; p++)
+        {
+            double g = G(p,p);
+            for(int m = 0; m < M1; m++)
+            {
+                int i = (p*M1)+m;
+                (*di)(i) = g - muP(p) - (d*m);
+                (*lo)(i) = (m > 0) ? muP(p) : 0;
+                (*up)(i) = (m < maxM) ? d*(m+1) : 0;
+            }
+        }
+    }
+    
+    double maxRate()
+    {
+        double q = 0;
+        for(int p = 0; p < nP; p++)
+            q = std::max(q,muP(p) + (d*maxM) - G(p,p));
+        return q;
+    }
+};
+
+class KronModel
+{
+public:
+    int K, M, maxM;
+    int nP;
+    Mat<int> S;
+    Mat<int> E;
+    ivec iMu;
+    int iD;
+    vec kX;
+    bool ok;
+    sp_mat G0;
+    uvec eP, eC, eK;
+    vec eS;
+    uvec dP;
+    
+    KronModel(int myK, int myM, int myMaxM, vec myKX = vec(), Mat<int> myE = Mat<int>())
+    {
+        K = myK;
+        M = myM;
+        maxM = myMaxM;
+        kX = myKX;
+        ok = true;
+        if(myE.n_rows > 0 && myE.n_cols != 3)
+        {
+            cout << "ERROR: Transitions are [from,to,rate index]; using the default chain." << endl;
+            myE.reset();
+            ok = false;
+        }
+        int nS = std::max(M-3,0);   // States with a fixed synthesis rate.
+        if(myE.n_rows == 0 && kX.n_elem != (uword) (3*nS))
+        {
+            cout << "ERROR: " << 3*nS << " rates of states >= 3 are needed; set to 0." << endl;
+            kX.zeros(3*nS);
+            ok = false;
+        }
+        else if(kX.n_elem < (uword) nS)
+        {
+            cout << "ERROR: At least " << nS << " rates (mu3...) are needed; set to 0." << endl;
+            kX.zeros(nS);
+            ok = false;
+        }
+        int iX = 8 + kX.n_elem - nS;    // theta index of mu3.
+        // Promoter states, ordered by the copies in the last state first:
+        vector<int> c(M,0);
+        vector<vector<int> > all;
+        enumS(M-1,K,&c,&all);
+        nP = all.size();
+        S.set_size(nP,M);
+        for(int p = 0; p < nP; p++)
+            for(int j = 0; j < M; j++)
+                S(p,j) = all[p][j];
+        // Rate graph (by default OFF <-> ON <-> ONs <-> S3 <-> ...), indexed 
+        // as ParV for the first three states and as kX (i.e. theta(8+k)) for 
+        // the rest:
+        E.set_size(0,3);
+        iMu.set_size(M);
+        int eK[4] = {0,1,2,3};      // kON, kOFF, kONs, kOFFs
+        int mK[3] = {4,5,6};        // mu0, mu, muS
+        for(int j = 0; j < M; j++)
+        {
+            iMu(j) = (j < 3) ? mK[j] : iX + (j-3);
+            if(j > 0 && myE.n_rows == 0)
+            {
+                pushRate(j-1,j,(j < 3) ? eK[2*(j-1)] : 8 + (2*(j-3)));
+                pushRate(j,j-1,(j < 3) ? eK[(2*(j-1))+1] : 9 + (2*(j-3)));
+            }
+        }
+        for(uword e = 0; e < myE.n_rows; e++)
+        {
+            int from = myE(e,0), to = myE(e,1), k = myE(e,2);
+            if(from < 0 || from >= M || to < 0 || to >= M || from == to
+                    || k < 0 || (k > 3 && k < 8) || k >= iX)
+            {
+                cout << "ERROR: Transition " << from << "->" << to << " (rate " << k << ") not valid; dropped." << endl;
+                ok = false;
+                continue;
+            }
+            pushRate(from,to,k);
+        }
+        iD = 7;
+        pattern();
+    }
+    
+    void enumS(int j, int left, vector<int> *c, vector<vector<int> > *all)
+    {
+        if(j == 0)
+        {
+            (*c)[0] = left;
+            all->push_back(*c);
+            return;
+        }
+        for(int k = 0; k <= left; k++)
+        {
+            (*c)[j] = k;
+            enumS(j-1,left-k,c,all);
+        }
+    }
+    
+    void pushRate(int from, int to, int k)
+    {
+        E.resize(E.n_rows+1,3);
+        E(E.n_rows-1,0) = from;
+        E(E.n_rows-1,1) = to;
+        E(E.n_rows-1,2) = k;
+    }
+    
+    void addRate(int from, int to, int k)
+    {
+        pushRate(from,to,k);
+        pattern();
+    }
+    
+    int index(const int *occ)
+    {
+        for(int p = 0; p < nP; p++)
+        {
+            bool eq = true;
+            for(int j = 0; j < M && eq; j++)
+                eq = (S(p,j) == occ[j]);
+            if(eq)
+                return p;
+        }
+        return -1;
+    }
+    
+    void pattern()
+    {
+        // Promoter transitions of one copy, symmetrized to occupation numbers:
+        vector<uword> r, c, k;
+        vector<double> sc;
+        vector<int> occ(M);
+        for(int p = 0; p < nP; p++)
+        {
+            for(uword e = 0; e < E.n_rows; e++)
+            {
+                int from = E(e,0);
+                if(S(p,from) == 0)
+                    continue;
+                for(int j = 0; j < M; j++)
+                    occ[j] = S(p,j);
+                occ[from]--;
+                occ[E(e,1)]++;
+                r.push_back(index(&occ[0]));
+                c.push_back(p);
+                k.push_back(E(e,2));
+                sc.push_back(S(p,from));
+            }
+        }
+        int nE = r.size();
+        umat loc(2,nE+nP);
+        for(int i = 0; i < nE; i++)
+        {
+            loc(0,i) = r[i];
+            loc(1,i) = c[i];
+        }
+        for(int p = 0; p < nP; p++)
+        {
+            loc(0,nE+p) = p;
+            loc(1,nE+p) = p;
+        }
+        // Repeated positions (several edges between the same states) add up:
+        G0 = sp_mat(true,loc,ones<vec>(nE+nP),nP,nP);
+        eP.set_size(nE);
+        eC = conv_to<uvec>::from(c);
+        eK = conv_to<uvec>::from(k);
+        eS = conv_to<vec>::from(sc);
+        dP.set_size(nP);
+        for(int i = 0; i < nE+nP; i++)
+        {
+            uword q = loc(1,i);
+            uword pos = G0.col_ptrs[q];
+            while(G0.row_indices[pos] != loc(0,i))
+                pos++;
+            if(i < nE)
+                eP(i) = pos;
+            else
+                dP(q) = pos;
+        }
+    }
+    
+    void TransMk(const vec &theta, kronGen *A)
+    {
+        A->nP = nP;
+        A->maxM = maxM;
+        A->d = theta(iD);
+        if(A->G.n_rows != (uword) nP || A->G.n_nonzero != G0.n_nonzero)
+            A->G = G0;      // Pattern; only on first use.
+        if(A->muP.n_elem != (uword) nP)
+            A->muP.set_size(nP);
+        for(int p = 0; p < nP; p++)
+        {
+            double b = 0;
+            for(int j = 0; j < M; j++)
+                b += S(p,j)*theta(iMu(j));
+            A->muP(p) = b;
+        }
+        double *va = access::rwp(A->G.values);
+        for(uword i = 0; i < A->G.n_nonzero; i++)
+            va[i] = 0;
+        for(uword i = 0; i < eP.n_elem; i++)
+        {
+            double rate = eS(i)*theta(eK(i));
+            va[eP(i)] += rate;
+            va[dP(eC(i))] -= rate;
+        }
+    }
+    
+    void TransMk(const Par &p, kronGen *A)
+    {
+        if(A->th.n_elem != (8 + kX.n_elem))
+            A->th.set_size(8 + kX.n_elem);     // Only on first use.
+        A->th(0) = p.kON;
+        A->th(1) = p.kOFF;
+        A->th(2) = p.kONs;
+        A->th(3) = p.kOFFs;
+        A->th(4) = p.mu0;
+        A->th(5) = p.mu;
+        A->th(6) = p.muS;
+        A->th(7) = p.d;
+        for(uword k = 0; k < kX.n_elem; k++)
+            A->th(8+k) = kX(k);
+        TransMk(A->th,A);
     }
 };
 
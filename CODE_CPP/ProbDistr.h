@@ -26,16 +26,138 @@
  * ProbDistr : Stationary probability distribution and protein distribution 
  *  dynamics.
  * 
- *  mat Pss(mat A) : Given the transition matrix A, returns the stationary 
- *      probability distribution vector.
+ *  class lxtWork(ModelStruct *ms, int T), lxtWork(KronModel *km, int T) : 
+ *      Workspace with every buffer 
+ *      needed to evaluate the log-likelihood, sized once for the model ms and 
+ *      T time points and reused across evaluations (i.e. MRW iterations).
+ *      mat L : Log-likelihood per time point, L(1,T).
+ *      mat Ab, As, At5 : Dense transition matrices (basal & stimulus) and 
+ *          propagation matrix over 5 min; allocated on first use.
+ *      spGen sAb, sAs : Sparse transition matrices (see LxTit).
+ *      spGenF fAs : Single precision copy of sAs (see LxTmix).
+ *      kronGen kAb, kAs : Factored transition matrices (see LxTk).
+ *      mat P, Pt : Probability distribution vectors.
+ *      bool keepP : If true, every LxT variant also keeps the probability 
+ *          distribution per time point in PT (n x T; see Server.h).
+ *      vec v : Values of the transition matrix (see ModelStruct::Rates).
  * 
- *  double logL(Mat<int> x, mat P) : Calculate the log-likelihood of observing 
- *      the data x given the probability distribution vector P.
+ *  void Pss(mat *A, mat *P) : Given the transition matrix A, writes the 
+ *      stationary probability distribution vector in P.
+ *  mat Pss(mat A) : As above, but returns the distribution.
  * 
+ *  double logL(Mat<int> *x, mat *P) : Calculate the log-likelihood of 
+ *      observing the data x given the probability distribution vector P.
+ *  double logL(Mat<int> x, mat P) : As above.
+ * 
+ *  void LxT(ModelStruct *ms, myData *x, const Par &pB, const Par &pS, int T, 
+ *      int *myT, lxtWork *w) : Iterate over time points myT[T] to estimate 
+ *      the log-likelihood of observing the data x under the model ms with 
+ *      paramters pB in basal state and pS after stimulus, and writes it in 
+ *      the matrix w->L(1,T).
  *  mat LxT(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT) : 
- *      Iterate over time points myT[T] to estimate the log-likelihood of 
- *      observing the data x under the model ms with paramters pB in basal 
- *      state and pS after stimulus, and returns a matrix L(1,T).
+ *      As above, but with a temporary workspace and returns L(1,T).
+ * 
+ *  class itSolver : Settings, warm start and counters of the iterative 
+ *      solvers.
+ *      double tol : Relative residual tolerance of the stationary solver and 
+ *          Poisson tail mass of the transient solver.
+ *      int maxIt : Maximum iterations of the stationary solver.
+ *      mat p0 : Stationary distribution of the current (accepted) state, 
+ *          used as starting point for the next proposal.
+ *      mat pt : Stationary distribution of the last proposal.
+ *      int nSolve, nIt, nFB : Number of stationary solves, iterations, and 
+ *          fall-backs to Pss because of non-convergence.
+ *      int nStep, nMV : Number of transient steps and matrix-vector products.
+ * 
+ *      void accept() : The last proposal becomes the current state.
+ * 
+ *  class triPre(int n) : Tridiagonal (i.e. mRNA birth-death within each 
+ *      promoter state) preconditioner of a n x n transition matrix with its 
+ *      first row replaced by ones.
+ *      void factor(genOp *A) : Factorizes the preconditioner of A.
+ *      void solve(const double *r, double *z) : Solves M*z = r.
+ * 
+ *  void PssIt(genOp *A, itSolver *is, lxtWork *w) : As Pss, but solves the 
+ *      sparse system A*P = 0, sum(P) = 1 by preconditioned BiCGSTAB starting 
+ *      from is->p0, and writes the distribution in w->P and is->pt. If it 
+ *      does not converge, or a residual is not finite, it falls back to Pss.
+ * 
+ *  int propN(genOp *A, double dt, itSolver *is) : Number of products of 
+ *      A that propU(A,dt,is,w) computes.
+ * 
+ *  void propU(genOp *A, double dt, itSolver *is, lxtWork *w) : Propagates 
+ *      w->P over dt minutes by uniformization of the sparse transition 
+ *      matrix, truncating the Poisson series when its remaining mass is 
+ *      below tol.
+ * 
+ *  void LxTit(ModelStruct *ms, myData *x, const Par &pB, const Par &pS, 
+ *      int T, int *myT, itSolver *is, lxtWork *w) : As LxT, but with the 
+ *      sparse iterative solvers; it does not allocate memory.
+ *  mat LxTit(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT, 
+ *      itSolver *is) : As above, but with a temporary workspace.
+ * 
+ *  class mixPar : Settings and counters of the mixed-precision propagation.
+ *      double massTol : Maximum change of total probability per step.
+ *      double relTol : Maximum relative error allowed on the probability of 
+ *          every state (so the log-likelihood error is below relTol times 
+ *          the number of cells).
+ *      int nEval : Number of mixed-precision evaluations.
+ *      int nFB : Number of evaluations that fell back to double precision.
+ *      int nDbl : Number of evaluations run in double precision only, 
+ *          because the error bound of their products was above relTol.
+ *      int cmpE : Compare with the double precision propagation every cmpE 
+ *          evaluations (0: never).
+ *      int nCmp : Number of comparisons.
+ *      double tMix, tDbl : Time (s) of the compared propagations, in single 
+ *          and in double precision.
+ *      double maxDL : Maximum |logL error| per time point of the compared 
+ *          evaluations.
+ * 
+ *  bool propT(genOp *A, myData *x, int T, int *myT, itSolver *is, 
+ *      mixPar *mp, lxtWork *w, mat *L, bool keep) : Propagates w->P (i.e. 
+ *      the stationary distribution) over the time points with A, and writes 
+ *      the log-likelihood in L (and the distributions in w->PT if keep). 
+ *      With mp (i.e. single precision A), the mass is checked and 
+ *      renormalized at every time point; returns false if it is not finite 
+ *      or changes more than mp->massTol.
+ * 
+ *  void LxTmix(ModelStruct *ms, myData *x, const Par &pB, const Par &pS, 
+ *      int T, int *myT, itSolver *is, mixPar *mp, lxtWork *w) : As LxTit, 
+ *      but the transient products (the bandwidth-bound part) use the single 
+ *      precision copy w->fAs. The number of products is known beforehand 
+ *      (propN); if the error bound of the evaluation (FLT_EPSILON/2 per 
+ *      product) is above relTol, only w->sAs is used. If a check fails, the 
+ *      propagation is repeated with w->sAs from the same stationary 
+ *      distribution. Every mp->cmpE evaluations both propagations are timed 
+ *      and compared (the result is still the single precision one, and the 
+ *      products of the comparison are not counted in is).
+ *  mat LxTmix(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT, 
+ *      itSolver *is, mixPar *mp) : As above, but with a temporary workspace.
+ * 
+ *  void LxTk(KronModel *km, myData *x, const Par &pB, const Par &pS, int T, 
+ *      int *myT, itSolver *is, lxtWork *w) : As LxTit, for the general K 
+ *      copies and M promoter states model km (see Model.h).
+ *  mat LxTk(KronModel *km, myData *x, Par pB, Par pS, int T, int *myT, 
+ *      itSolver *is) : As above, but with a temporary workspace.
+ * 
+ *  class lxtEval(ModelStruct *ms, KronModel *km, myData *x, int T, int *myT, 
+ *      bool itS, bool mixP) : Log-likelihood evaluator with its own workspace 
+ *      and solver state, so that one per thread can be used in parallel. If 
+ *      km is not NULL the general model is used (LxTk); otherwise LxTmix, 
+ *      LxTit or LxT as selected by mixP and itS.
+ *      double eval(const ParV &pB, const ParV &pS) : Total log-likelihood of 
+ *          the parameters (-Inf if not a number); w.L keeps the value per 
+ *          time point. The iterative solvers are warm-started from the 
+ *          previous evaluation.
+ *      double eval(const ParV &pB, const ParV &pS, myData *x, itSolver *is) : 
+ *          As above, for another data set (with the same model) and solver 
+ *          state, e.g. one per gene sharing the workspace (see Hier.h).
+ *      int nEval : Number of evaluations.
+ * 
+ *  void parFor(int nThr, int n, F f) : Calls f(k,j) for j = 0...n-1 in nThr 
+ *      threads, where k is the thread (e.g. the index of its lxtEval); every 
+ *      thread takes the next j when it finishes one, so the j are started in 
+ *      order (e.g. the longest evaluations first).
  * 
  */
 
@@ -49,6 +171,10 @@
 #include <iostream>
 #include <algorithm>
 #include <vector>
+#include <cfloat>
+#include <chrono>
+#include <thread>
+#include <atomic>
 #include <armadillo>
 #include "Data.h"
 #include "Model.h"
@@ -56,53 +182,591 @@
 using namespace std;
 using namespace arma;
 
-mat Pss(mat A)
+class triPre
+{
+public:
+    vec lo, di, up, cp, m;
+    
+    triPre(int n)
+    {
+        lo.zeros(n);
+        di.zeros(n);
+        up.zeros(n);
+        cp.zeros(n);
+        m.zeros(n);
+    }
+    
+    void factor(genOp *A)
+    {
+        int n = A->size();
+        A->tri(&lo,&di,&up);
+        // First row replaced by the normalization, sum(P) = 1:
+        di(0) = 1;
+        up(0) = 1;
+        // Thomas algorithm factorization:
+        m(0) = di(0);
+        cp(0) = up(0)/m(0);
+        for(int i = 1; i < n; i++)
+        {
+            m(i) = di(i) - (lo(i)*cp(i-1));
+            cp(i) = up(i)/m(i);
+        }
+    }
+    
+    void solve(const double *r, double *z)
+    {
+        int n = m.n_elem;
+        z[0] = r[0]/m(0);
+        for(int i = 1; i < n; i++)
+            z[i] = (r[i] - (lo(i)*z[i-1]))/m(i);
+        for(int i = n-2; i >= 0; i--)
+            z[i] -= cp(i)*z[i+1];
+    }
+};
+
+class lxtWork
+{
+public:
+    int n;
+    mat L;
+    mat Ab, As, At5;
+    spGen sAb, sAs;
+    spGenF fAs;
+    kronGen kAb, kAs;
+    mat P, Pt;
+    bool keepP;
+    mat PT;
+    vec v;
+    // Iterative solvers:
+    triPre M;
+    mat r, rh, p, q, ph, s, sh, t, y;
+    
+    lxtWork(ModelStruct *ms, int T) : M(ms->S.n_rows)
+    {
+        init(ms->S.n_rows,T);
+        sAb.A = ms->spA;
+        sAs.A = ms->spA;
+        v.zeros(ms->R.n_rows);
+    }
+    
+    lxtWork(KronModel *km, int T) : M(km->nP*(km->maxM+1))
+    {
+        init(km->nP*(km->maxM+1),T);
+    }
+    
+    void init(int myN, int T)
+    {
+        n = myN;
+        keepP = false;
+        L.zeros(1,T);
+        P.zeros(n,1);
+        Pt.zeros(n,1);
+        r.zeros(n,1);
+        rh.zeros(n,1);
+        p.zeros(n,1);
+        q.zeros(n,1);
+        ph.zeros(n,1);
+        s.zeros(n,1);
+        sh.zeros(n,1);
+        t.zeros(n,1);
+        y.zeros(n,1);
+    }
+};
+
+void Pss(mat *A, mat *P)
 {
     cx_vec eigval;
     cx_mat eigvec;
-    eig_gen(eigval,eigvec,A); 
-    
-    mat Pss = abs(eigvec.col((abs(eigval)).index_min()));
-    mat n = sum(Pss);
-    Pss = Pss/n(0,0);
+    eig_gen(eigval,eigvec,*A); 
     
-    return Pss;
+    (*P) = abs(eigvec.col((abs(eigval)).index_min()));
+    (*P) /= accu(*P);
 }
 
-double logL(Mat<int> x, mat P)
+mat Pss(mat A)
 {
-    P.reshape(size(x));
-    double L = sum(sum(x % trunc_log(P)));
+    mat P;
+    Pss(&A,&P);
+    return P;
+}
+
+double logL(Mat<int> *x, mat *P)
+{
+    const int *xi = x->memptr();
+    const double *pi = P->memptr();
+    double L = 0;
+    for(uword i = 0; i < x->n_elem; i++)
+        if(xi[i] != 0)
+            L += xi[i]*trunc_log(pi[i]);
     return L;
 }
 
-mat LxT(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT)
+double logL(Mat<int> x, mat P)
 {
-    mat L(1,T);
-    mat Ab = ms->TransM(pB);
-    mat As = ms->TransM(pS);
-    mat At5 = expmat(As*5);
-    mat P[T];
+    return logL(&x,&P);
+}
+
+void LxT(ModelStruct *ms, myData *x, const Par &pB, const Par &pS, int T, int *myT, lxtWork *w)
+{
+    ms->TransM(pB,&w->Ab,&w->v);
+    ms->TransM(pS,&w->As,&w->v);
+    w->At5 = expmat(w->As*5);
     for(int t = 0; t < T; t++)
     {
         if(t==0)
         {
-            P[t] = Pss(Ab);
+            Pss(&w->Ab,&w->P);
         }
         else
         {
             int temp = myT[t] - myT[t-1];
-            P[t] = P[t-1];
             while(temp > 0)
             {
-                P[t] = At5*P[t];
+                w->Pt = w->At5*w->P;
+                w->P.swap(w->Pt);
                 temp -=5;
             }
         }
-        L(0,t) = logL(x[t].data, P[t]);
+        w->L(0,t) = logL(&x[t].data,&w->P);
+        if(w->keepP)
+            w->PT.col(t) = w->P;
     }
-    return L;
 };
 
-#endif /* PROBDISTR_H */
+mat LxT(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT)
+{
+    lxtWork w(ms,T);
+    LxT(ms,x,pB,pS,T,myT,&w);
+    return w.L;
+};
+
+class itSolver
+{
+public:
+    double tol;
+    int maxIt;
+    mat p0;
+    mat pt;
+    int nSolve, nIt, nFB;
+    int nStep, nMV;
+    
+    itSolver()
+    {
+        tol = 1e-10;
+        maxIt = 500;
+        nSolve = 0;
+        nIt = 0;
+        nFB = 0;
+        nStep = 0;
+        nMV = 0;
+    }
+    
+    void accept()
+    {
+        p0 = pt;
+    }
+};
 
+// Transition matrix with its first row replaced by ones:
+void mulN(genOp *A, const double *x, double *y)
+{
+    A->apply(x,y);
+    double sx = 0;
+    for(int i = 0; i < A->size(); i++)
+        sx += x[i];
+    y[0] = sx;
+}
+
+void PssIt(genOp *A, itSolver *is, lxtWork *w)
+{
+    int n = A->size();
+    is->nSolve++;
+    if(is->p0.n_elem == n)
+        w->P = is->p0;
+    else
+        w->P.ones(n,1);
+    w->P /= accu(w->P);
+    double *x = w->P.memptr();
+    double *r = w->r.memptr();
+    double *rh = w->rh.memptr();
+    double *p = w->p.memptr();
+    double *v = w->q.memptr();
+    double *ph = w->ph.memptr();
+    double *s = w->s.memptr();
+    double *sh = w->sh.memptr();
+    double *t = w->t.memptr();
+    
+    // Preconditioned BiCGSTAB for N*x = [1,0,...,0]':
+    w->M.factor(A);
+    mulN(A,x,r);
+    for(int i = 0; i < n; i++)
+    {
+        r[i] = -r[i];
+        rh[i] = r[i];
+        p[i] = 0;
+        v[i] = 0;
+    }
+    r[0] += 1;
+    rh[0] += 1;
+    double rho = 1, alpha = 1, omega = 1;
+    bool conv = (sqrt(dot(w->r,w->r)) <= is->tol);
+    int it = 0;
+    while(!conv && it < is->maxIt)
+    {
+        it++;
+        double rho1 = dot(w->rh,w->r);
+        if(rho1 == 0 || !std::isfinite(rho1))   // Breakdown, or NaN/Inf.
+            break;
+        double beta = (rho1/rho)*(alpha/omega);
+        for(int i = 0; i < n; i++)
+            p[i] = r[i] + (beta*(p[i] - (omega*v[i])));
+        w->M.solve(p,ph);
+        mulN(A,ph,v);
+        alpha = rho1/dot(w->rh,w->q);
+        for(int i = 0; i < n; i++)
+            s[i] = r[i] - (alpha*v[i]);
+        double sn = sqrt(dot(w->s,w->s));
+        if(!std::isfinite(sn))
+            break;
+        if(sn <= is->tol)
+        {
+            for(int i = 0; i < n; i++)
+                x[i] += alpha*ph[i];
+            conv = true;
+            break;
+        }
+        w->M.solve(s,sh);
+        mulN(A,sh,t);
+        omega = dot(w->t,w->s)/dot(w->t,w->t);
+        for(int i = 0; i < n; i++)
+        {
+            x[i] += (alpha*ph[i]) + (omega*sh[i]);
+            r[i] = s[i] - (omega*t[i]);
+        }
+        double rn = sqrt(dot(w->r,w->r));
+        if(!std::isfinite(rn))
+            break;
+        conv = (rn <= is->tol);
+        rho = rho1;
+    }
+    is->nIt += it;
+    
+    if(conv && w->P.is_finite())
+    {
+        double sx = 0;
+        for(int i = 0; i < n; i++)
+        {
+            x[i] = fabs(x[i]);
+            sx += x[i];
+        }
+        w->P /= sx;
+    }
+    else
+    {
+        is->nFB++;
+        mat Ad(n,n);
+        w->Pt.zeros();
+        for(int j = 0; j < n; j++)
+        {
+            w->Pt(j) = 1;
+            A->apply(w->Pt.memptr(),Ad.colptr(j));
+            w->Pt(j) = 0;
+        }
+        Pss(&Ad,&w->P);
+    }
+    is->pt = w->P;
+}
+
+int propN(genOp *A, double dt, itSolver *is)
+{
+    double q = A->maxRate();
+    if(q == 0)
+        return 0;
+    // As propU, without the products:
+    int nSub = (int) ceil(q*dt/100);
+    double lam = q*(dt/nSub);
+    double wj = exp(-lam);
+    double cum = wj;
+    int n = 0;
+    for(int j = 1; (1-cum) > is->tol && j < (10*lam)+100; j++)
+    {
+        wj *= lam/j;
+        cum += wj;
+        n++;
+    }
+    return n*nSub;
+}
+
+void propU(genOp *A, double dt, itSolver *is, lxtWork *w)
+{
+    int n = A->size();
+    double q = A->maxRate();
+    if(q == 0)
+        return;
+    // Split the step to keep exp(-q*h) far from underflow:
+    int nSub = (int) ceil(q*dt/100);
+    double h = dt/nSub;
+    for(int k = 0; k < nSub; k++)
+    {
+        double *v = w->P.memptr();
+        double *y = w->y.memptr();
+        double *Av = w->Pt.memptr();
+        double lam = q*h;
+        double wj = exp(-lam);
+        double cum = wj;
+        for(int i = 0; i < n; i++)
+            y[i] = wj*v[i];
+        for(int j = 1; (1-cum) > is->tol && j < (10*lam)+100; j++)
+        {
+            A->apply(v,Av);
+            is->nMV++;
+            wj *= lam/j;
+            cum += wj;
+            for(int i = 0; i < n; i++)
+            {
+                v[i] += Av[i]/q;
+                y[i] += wj*v[i];
+            }
+        }
+        w->P.swap(w->y);
+    }
+    is->nStep++;
+}
+
+void LxTit(ModelStruct *ms, myData *x, const Par &pB, const Par &pS, int T, int *myT, itSolver *is, lxtWork *w)
+{
+    ms->TransMsp(pB,&w->sAb.A,&w->v);
+    ms->TransMsp(pS,&w->sAs.A,&w->v);
+    PssIt(&w->sAb,is,w);
+    for(int t = 0; t < T; t++)
+    {
+        if(t > 0)
+            propU(&w->sAs,myT[t]-myT[t-1],is,w);
+        w->L(0,t) = logL(&x[t].data,&w->P);
+        if(w->keepP)
+            w->PT.col(t) = w->P;
+    }
+};
+
+mat LxTit(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT, itSolver *is)
+{
+    lxtWork w(ms,T);
+    LxTit(ms,x,pB,pS,T,myT,is,&w);
+    return w.L;
+};
+
+class mixPar
+{
+public:
+    double massTol;
+    double relTol;
+    int nEval;
+    int nFB;
+    int nDbl;
+    int cmpE;
+    int nCmp;
+    double tMix, tDbl;
+    double maxDL;
+    mat Ld;
+    
+    mixPar()
+    {
+        massTol = 1e-6;
+        relTol = 1e-4;
+        nEval = 0;
+        nFB = 0;
+        nDbl = 0;
+        cmpE = 100;
+        nCmp = 0;
+        tMix = 0;
+        tDbl = 0;
+        maxDL = 0;
+    }
+};
+
+bool propT(genOp *A, myData *x, int T, int *myT, itSolver *is, mixPar *mp, lxtWork *w, mat *L, bool keep)
+{
+    for(int t = 0; t < T; t++)
+    {
+        if(t > 0)
+        {
+            double m0 = accu(w->P);
+            propU(A,myT[t]-myT[t-1],is,w);
+            double m1 = accu(w->P);
+            if(mp)
+            {
+                if(!w->P.is_finite() || fabs(m1-m0) > mp->massTol*m0)
+                    return false;
+                w->P *= m0/m1;      // Renormalize the single precision iterate.
+            }
+        }
+        (*L)(0,t) = logL(&x[t].data,&w->P);
+        if(keep)
+            w->PT.col(t) = w->P;
+    }
+    return true;
+}
+
+void LxTmix(ModelStruct *ms, myData *x, const Par &pB, const Par &pS, int T, int *myT, itSolver *is, mixPar *mp, lxtWork *w)
+{
+    mp->nEval++;
+    ms->TransMsp(pB,&w->sAb.A,&w->v);
+    ms->TransMsp(pS,&w->sAs.A,&w->v);
+    PssIt(&w->sAb,is,w);
+    // Relative error bound of every probability, FLT_EPSILON/2 per product; 
+    // if it cannot hold, the single precision pass is not worth trying:
+    int nMV = 0;
+    for(int t = 1; t < T; t++)
+        nMV += propN(&w->sAs,myT[t]-myT[t-1],is);
+    if(nMV*(FLT_EPSILON/2) > mp->relTol)
+    {
+        mp->nDbl++;
+        propT(&w->sAs,x,T,myT,is,NULL,w,&w->L,w->keepP);
+        return;
+    }
+    w->fAs.load(&w->sAs);
+    bool cmp = (mp->cmpE > 0) && ((mp->nEval % mp->cmpE) == 0);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    bool ok = propT(&w->fAs,x,T,myT,is,mp,w,&w->L,w->keepP);
+    if(!ok || cmp)
+    {
+        double tF = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if(mp->Ld.n_elem != (uword) T)
+            mp->Ld.set_size(1,T);   // Only on first use.
+        // Same propagation in double precision, from the stationary 
+        // distribution of this evaluation (i.e. without solving it again):
+        w->P = is->pt;
+        int nStep = is->nStep;
+        int nMV = is->nMV;
+        t0 = chrono::steady_clock::now();
+        propT(&w->sAs,x,T,myT,is,NULL,w,ok ? &mp->Ld : &w->L,w->keepP && !ok);
+        if(!ok)
+        {
+            mp->nFB++;
+            return;
+        }
+        is->nStep = nStep;  // The comparison is not part of the evaluation.
+        is->nMV = nMV;
+        mp->nCmp++;
+        mp->tMix += tF;
+        mp->tDbl += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        for(int t = 0; t < T; t++)
+            mp->maxDL = std::max(mp->maxDL,fabs(w->L(0,t) - mp->Ld(0,t)));
+    }
+};
+
+mat LxTmix(ModelStruct *ms, myData *x, Par pB, Par pS, int T, int *myT, itSolver *is, mixPar *mp)
+{
+    lxtWork w(ms,T);
+    LxTmix(ms,x,pB,pS,T,myT,is,mp,&w);
+    return w.L;
+};
+
+void LxTk(KronModel *km, myData *x, const Par &pB, const Par &pS, int T, int *myT, itSolver *is, lxtWork *w)
+{
+    km->TransMk(pB,&w->kAb);
+    km->TransMk(pS,&w->kAs);
+    PssIt(&w->kAb,is,w);
+    for(int t = 0; t < T; t++)
+    {
+        if(t > 0)
+            propU(&w->kAs,myT[t]-myT[t-1],is,w);
+        w->L(0,t) = logL(&x[t].data,&w->P);
+        if(w->keepP)
+            w->PT.col(t) = w->P;
+    }
+};
+
+mat LxTk(KronModel *km, myData *x, Par pB, Par pS, int T, int *myT, itSolver *is)
+{
+    lxtWork w(km,T);
+    LxTk(km,x,pB,pS,T,myT,is,&w);
+    return w.L;
+};
+
+class lxtEval
+{
+public:
+    ModelStruct *ms;
+    KronModel *km;
+    myData *x;
+    int T;
+    int *myT;
+    bool itS, mixP;
+    lxtWork w;
+    itSolver is;
+    mixPar mp;
+    int nEval;
+    
+    lxtEval(ModelStruct *myMs, KronModel *myKm, myData *myX, int myTn, int *myTs, bool myItS, bool myMixP)
+        : w(myKm ? lxtWork(myKm,myTn) : lxtWork(myMs,myTn))
+    {
+        ms = myMs;
+        km = myKm;
+        x = myX;
+        T = myTn;
+        myT = myTs;
+        itS = myItS;
+        mixP = myMixP;
+        nEval = 0;
+    }
+    
+    void toPar(const ParV &v, Par *p)
+    {
+        p->kON = v(0);
+        p->kOFF = v(1);
+        p->kONs = v(2);
+        p->kOFFs = v(3);
+        p->mu0 = v(4);
+        p->mu = v(5);
+        p->muS = v(6);
+        p->d = v(7);
+    }
+    
+    double eval(const ParV &pB, const ParV &pS)
+    {
+        return eval(pB,pS,x,&is);
+    }
+    
+    double eval(const ParV &pB, const ParV &pS, myData *myX, itSolver *myIs)
+    {
+        Par qB, qS;
+        toPar(pB,&qB);
+        toPar(pS,&qS);
+        if(km)
+            LxTk(km,myX,qB,qS,T,myT,myIs,&w);
+        else if(mixP)
+            LxTmix(ms,myX,qB,qS,T,myT,myIs,&mp,&w);
+        else if(itS)
+            LxTit(ms,myX,qB,qS,T,myT,myIs,&w);
+        else
+            LxT(ms,myX,qB,qS,T,myT,&w);
+        nEval++;
+        double l = accu(w.L);
+        if(l != l)
+            return -datum::inf;
+        if(km || itS || mixP)
+            myIs->accept();
+        return l;
+    }
+};
+
+template<typename F>
+void parFor(int nThr, int n, F f)
+{
+    atomic<int> next(0);
+    vector<thread> th;
+    for(int k = 0; k < nThr; k++)
+    {
+        th.push_back(thread([&,k]()
+        {
+            int j;
+            while((j = next++) < n)
+                f(k,j);
+        }));
+    }
+    for(unsigned int k = 0; k < th.size(); k++)
+        th[k].join();
+}
+
+#endif /* PROBDISTR_H */
@@ -0,0 +1,219 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * REWEIGHT: Reuse a previous MRW chain for a new target (e.g. new data, time
+ *           points, threshold a or maxM) by importance sampling.
+ *
+ * Reweight : The previous chain is read from its run-length encoded file
+ *      (*_Uniq.dat, see main.cpp), so every unique accepted parameter set is
+ *      evaluated only once. Under the flat priors of the MRW, the weight of
+ *      each draw is exp(logL_new - logL_old).
+ *
+ *  class rwChain : Unique parameter sets of a previous chain.
+ *      int n : Number of unique parameter sets.
+ *      vector<ParV> pB, pS : Parameters.
+ *      vec c : Number of draws (after burn-in) of each set.
+ *      vec L0 : Log-likelihood of each set under the previous target.
+ *      mat L : Log-likelihood per time point under the new target (T x n).
+ *      vec w : Normalized importance weights (of all the draws of a set).
+ *      double ESS : Effective sample size, (sum c*r)^2/(sum c*r^2) where r
+ *          is the likelihood ratio of a draw.
+ *
+ *      bool read(char* myFile, int burn) : Read the chain, skipping the
+ *          first burn iterations and merging repeated parameter sets.
+ *      void eval(vector<lxtEval*> e) : Evaluate the new target for every
+ *          set, in parallel with one thread per evaluator (see parFor in
+ *          ProbDistr.h).
+ *      void weights() : Importance weights & ESS.
+ *      int sample() : Draw a set with probability w.
+ *      void summarize(mrwSummary *sum, mrwICs *ics) : Add every set to the 
+ *          summaries and the ICs with frequency weight w*sum(c), i.e. its 
+ *          expected number of draws under the new target; every set 
+ *          updates the MLE of ics.
+ *      void write(char* myFile) : Write the weights file.
+ *
+ */
+
+#ifndef REWEIGHT_H
+#define REWEIGHT_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <armadillo>
+#include "Model.h"
+#include "ProbDistr.h"
+#include "Summary.h"
+
+using namespace std;
+using namespace arma;
+
+class rwChain
+{
+public:
+    int n;
+    vector<ParV> pB, pS;
+    vec c;
+    vec L0;
+    mat L;
+    vec w;
+    double ESS;
+
+    rwChain()
+    {
+        n = 0;
+        ESS = 0;
+    }
+
+    bool read(char* myFile, int burn)
+    {
+        ifstream inputFile(myFile);
+        string line;
+        if(!getline(inputFile,line))
+            return false;
+        // Time points of the previous chain, from the header:
+        istringstream hs(line);
+        string h;
+        int T0 = 0;
+        while(hs >> h)
+            if(h.compare(0,5,"logL[") == 0)
+                T0++;
+        map<vector<double>,int> id;
+        vector<double> cv, lv;
+        vector<double> key(16);
+        while(getline(inputFile,line))
+        {
+            istringstream ss(line);
+            double it, dw;
+            double sL = 0;
+            if(!(ss >> it >> dw))
+                continue;
+            for(int t = 0; t < T0; t++)
+            {
+                double l;
+                ss >> l;
+                sL += l;
+            }
+            for(int j = 0; j < 16; j++)
+                ss >> key[j];
+            if(ss.fail())
+                continue;
+            // Draws of this state after burn-in, i.e. iterations [it,it+dw):
+            double k = (it + dw) - std::max(it,(double) burn+1);
+            if(k <= 0)
+                continue;
+            map<vector<double>,int>::iterator f = id.find(key);
+            if(f != id.end())
+            {
+                cv[f->second] += k;
+                continue;
+            }
+            id[key] = n;
+            ParV qB, qS;
+            for(int j = 0; j < 8; j++)
+            {
+                qB(j) = key[j];
+                qS(j) = key[j+8];
+            }
+            pB.push_back(qB);
+            pS.push_back(qS);
+            cv.push_back(k);
+            lv.push_back(sL);
+            n++;
+        }
+        c = conv_to<vec>::from(cv);
+        L0 = conv_to<vec>::from(lv);
+        return n > 0;
+    }
+
+    void eval(vector<lxtEval*> e)
+    {
+        L.set_size(e[0]->T,n);
+        parFor(e.size(),n,[&](int k, int j)
+        {
+            e[k]->eval(pB[j],pS[j]);
+            L.col(j) = e[k]->w.L.t();
+        });
+    }
+
+    void weights()
+    {
+        vec lw = log(c) + sum(L,0).t() - L0;
+        lw.elem(find_nonfinite(lw)).fill(-datum::inf);
+        w = exp(lw - lw.max());
+        w /= accu(w);
+        ESS = 1/accu(square(w)/c);
+    }
+
+    int sample()
+    {
+        double u = as_scalar(randu(1,1));
+        double cw = 0;
+        for(int j = 0; j < n; j++)
+        {
+            cw += w(j);
+            if(u <= cw)
+                return j;
+        }
+        return n-1;
+    }
+
+    void summarize(mrwSummary *sum, mrwICs *ics)
+    {
+        double D = accu(c);
+        for(int j = 0; j < n; j++)
+        {
+            double sL = accu(L.col(j));
+            ics->best(sL,pB[j],pS[j]);
+            if(w(j) > 0)
+            {
+                sum->add(pB[j],pS[j],L.col(j).t(),w(j)*D);
+                ics->add(sL,w(j)*D);
+            }
+        }
+    }
+
+    void write(char* myFile)
+    {
+        ofstream out(myFile,ios::out);
+        out.precision(6);
+        out << "Draws " << accu(c) << endl;
+        out << "Unique " << n << endl;
+        out << "ESS " << ESS << endl << endl;
+        out << "Count" << ' ' << "logL_old" << ' ';
+        for(int t = 0; t < (int) L.n_rows; t++)
+            out << "logL[" << t << "]" << ' ';
+        out << "Weight" << ' ' << "[B:kON...d]" << ' ' << "[S:kON...d]" << endl;
+        for(int j = 0; j < n; j++)
+        {
+            out << c(j) << ' ' << L0(j);
+            printRow(out,L.col(j).t());
+            out << ' ' << w(j);
+            printRow(out,pB[j]);
+            printRow(out,pS[j]);
+            out << endl;
+        }
+        out.close();
+    }
+};
+
+#endif /* REWEIGHT_H */
@@ -0,0 +1,378 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * SERVER: Answer log-likelihood queries over a local (Unix domain) socket,
+ *         so the model and data are loaded only once.
+ *
+ * Server : Binary batch protocol (native byte order, i.e. same machine).
+ *      Every message is a header of four uint32 [magic, op, n, m] followed
+ *      by n*m doubles. Requests send n parameter sets of m = 16 values,
+ *      [kON,kOFF,kONs,kOFFs,mu0,mu,muS,d] in basal and then in stimulus
+ *      state. Responses use the status (0 if OK) in place of op:
+ *      srvInfo (0) : n = 0; answer n = 1, m = 3+T: [T, states, maxM, myT].
+ *      srvLogL (1) : Answer log-likelihood per time point (m = T).
+ *      srvDist (2) : Answer probability distribution per time point
+ *          (m = states*T, time points outermost; state index is
+ *          p*(maxM+1)+m for promoter state p and m mRNA molecules).
+ *      srvStop (3) : n = 0; stop the server after answering (n = 0).
+ *      Requests with more than srvMaxN parameter sets, or whose answer would 
+ *      exceed srvMaxBytes, get the status srvTooLarge (as srvBadRequest, the 
+ *      connection is then closed); large batches must be split by the client.
+ *
+ *  class srvPool(vector<lxtEval*> myE) : Worker pool, one thread per
+ *      evaluator. Batches are split in chunks, and each worker takes the
+ *      next chunk when it finishes one.
+ *      void run(int op, int n, const double *in, double *out) : Evaluates
+ *          the n parameter sets of in and waits for the answer in out.
+ *      int m(int op) : Values per answered parameter set.
+ *
+ *  bool readAll(int fd, void *b, size_t n), bool writeAll(int fd,
+ *      const void *b, size_t n) : Read/write exactly n bytes (retrying 
+ *      when interrupted by a signal).
+ *
+ *  void srvRun(const char* myPath, srvPool *pool, int maxM) : Listen on
+ *      the socket myPath and answer every connection in its own thread,
+ *      until a srvStop request. A stale socket at myPath is replaced, but 
+ *      any other file is left untouched (error); the socket is only 
+ *      accessible to its owner (mode 0600).
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <armadillo>
+#include "ProbDistr.h"
+
+using namespace std;
+using namespace arma;
+
+const uint32_t srvMagic = 0x48534642;   // "BFSH"
+const uint32_t srvMaxN = 1 << 20;       // Maximum parameter sets per request.
+const size_t srvMaxBytes = 1 << 30;     // Maximum answer size (bytes).
+enum { srvInfo = 0, srvLogL = 1, srvDist = 2, srvStop = 3 };
+enum { srvOK = 0, srvBadRequest = 1, srvTooLarge = 2 };
+
+class srvBatch
+{
+public:
+    int op;
+    const double *in;
+    double *out;
+    int left;       // Chunks not finished yet.
+    mutex mx;
+    condition_variable cv;
+};
+
+class srvTask
+{
+public:
+    srvBatch *b;
+    int i0, i1;     // Parameter sets [i0,i1).
+};
+
+class srvPool
+{
+public:
+    vector<lxtEval*> e;
+    vector<thread> th;
+    deque<srvTask> q;
+    mutex mx;
+    condition_variable cv;
+    bool stop;
+    int T, nS;
+
+    srvPool(vector<lxtEval*> myE)
+    {
+        e = myE;
+        T = e[0]->T;
+        nS = e[0]->w.n;
+        stop = false;
+        for(unsigned int k = 0; k < e.size(); k++)
+        {
+            e[k]->w.keepP = true;
+            e[k]->w.PT.zeros(nS,T);
+            th.push_back(thread(&srvPool::work,this,k));
+        }
+    }
+
+    ~srvPool()
+    {
+        {
+            lock_guard<mutex> lk(mx);
+            stop = true;
+        }
+        cv.notify_all();
+        for(unsigned int k = 0; k < th.size(); k++)
+            th[k].join();
+    }
+
+    int m(int op)
+    {
+        return (op == srvDist) ? nS*T : T;
+    }
+
+    void run(int op, int n, const double *in, double *out)
+    {
+        if(n == 0)
+            return;
+        srvBatch b;
+        b.op = op;
+        b.in = in;
+        b.out = out;
+        // About four chunks per worker, so that batches are balanced:
+        int c = std::max(1,n/(4*(int) e.size()));
+        b.left = (n + c - 1)/c;
+        {
+            lock_guard<mutex> lk(mx);
+            for(int i = 0; i < n; i += c)
+            {
+                srvTask t;
+                t.b = &b;
+                t.i0 = i;
+                t.i1 = std::min(n,i+c);
+                q.push_back(t);
+            }
+        }
+        cv.notify_all();
+        unique_lock<mutex> lk(b.mx);
+        b.cv.wait(lk,[&b]() { return b.left == 0; });
+    }
+
+    void work(int k)
+    {
+        ParV pB, pS;
+        while(true)
+        {
+            srvTask t;
+            {
+                unique_lock<mutex> lk(mx);
+                cv.wait(lk,[this]() { return stop || !q.empty(); });
+                if(q.empty())
+                    return;
+                t = q.front();
+                q.pop_front();
+            }
+            int mo = m(t.b->op);
+            for(int i = t.i0; i < t.i1; i++)
+            {
+                const double *pi = t.b->in + (16*i);
+                for(int j = 0; j < 8; j++)
+                {
+                    pB(j) = pi[j];
+                    pS(j) = pi[j+8];
+                }
+                try
+                {
+                    e[k]->eval(pB,pS);
+                }
+                catch(...)      // e.g. the decomposition failed.
+                {
+                    e[k]->w.L.fill(datum::nan);
+                    e[k]->w.PT.fill(datum::nan);
+                }
+                const double *r = (t.b->op == srvDist) ? e[k]->w.PT.memptr() : e[k]->w.L.memptr();
+                memcpy(t.b->out + (mo*i),r,mo*sizeof(double));
+            }
+            lock_guard<mutex> lk(t.b->mx);
+            if(--t.b->left == 0)
+                t.b->cv.notify_all();
+        }
+    }
+};
+
+bool readAll(int fd, void *b, size_t n)
+{
+    char *c = (char*) b;
+    while(n > 0)
+    {
+        ssize_t r = read(fd,c,n);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return false;
+        c += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void *b, size_t n)
+{
+    const char *c = (const char*) b;
+    while(n > 0)
+    {
+        ssize_t r = send(fd,c,n,MSG_NOSIGNAL);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return false;
+        c += r;
+        n -= r;
+    }
+    return true;
+}
+
+void srvRun(const char* myPath, srvPool *pool, int maxM)
+{
+    int lfd = socket(AF_UNIX,SOCK_STREAM,0);
+    sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path,myPath,sizeof(addr.sun_path)-1);
+    struct stat st;
+    if(lstat(myPath,&st) == 0)
+    {
+        if(!S_ISSOCK(st.st_mode))
+        {
+            cout << "ERROR: " << myPath << " exists and is not a socket." << endl;
+            if(lfd >= 0)
+                close(lfd);
+            return;
+        }
+        unlink(myPath);     // Left by a previous server.
+    }
+    // Owner only, also between bind and chmod:
+    mode_t um = umask(0177);
+    bool ok = (lfd >= 0 && bind(lfd,(sockaddr*) &addr,sizeof(addr)) == 0);
+    umask(um);
+    if(!ok || chmod(myPath,0600) < 0 || listen(lfd,64) < 0)
+    {
+        cout << "ERROR: Cannot listen on " << myPath << ": " << strerror(errno) << endl;
+        if(lfd >= 0)
+            close(lfd);
+        return;
+    }
+    cout << "Listening on " << myPath << " (" << pool->e.size() << " workers)" << endl;
+
+    atomic<bool> stop(false);
+    mutex mx;
+    set<int> conn;      // Connections being answered.
+    condition_variable cv;
+    while(!stop)
+    {
+        int fd = accept(lfd,NULL,NULL);
+        if(fd < 0)
+        {
+            if(stop || errno != EINTR)
+                break;
+            continue;
+        }
+        {
+            lock_guard<mutex> lk(mx);
+            conn.insert(fd);
+        }
+        thread([&,fd]()
+        {
+            uint32_t h[4];
+            vector<double> in, out;
+            while(readAll(fd,h,sizeof(h)))
+            {
+                uint32_t op = h[1];
+                uint32_t n = h[2];
+                size_t nOut = (op == srvLogL || op == srvDist) ? ((size_t) n)*pool->m(op) : 0;
+                h[1] = srvOK;
+                if(h[0] != srvMagic || op > srvStop || (n > 0 && h[3] != 16))
+                    h[1] = srvBadRequest;
+                else if(n > srvMaxN || (nOut*sizeof(double)) > srvMaxBytes)
+                    h[1] = srvTooLarge;
+                if(h[1] == srvOK)
+                {
+                    try
+                    {
+                        in.resize(16*(size_t) n);
+                        out.resize(nOut);
+                    }
+                    catch(const bad_alloc &)
+                    {
+                        h[1] = srvTooLarge;
+                    }
+                }
+                if(h[1] != srvOK)   // The body (if any) cannot be trusted.
+                {
+                    h[2] = 0;
+                    h[3] = 0;
+                    writeAll(fd,h,sizeof(h));
+                    break;
+                }
+                if(n > 0 && !readAll(fd,&in[0],in.size()*sizeof(double)))
+                    break;
+                if(op == srvInfo)
+                {
+                    out.resize(3+pool->T);
+                    out[0] = pool->T;
+                    out[1] = pool->nS;
+                    out[2] = maxM;
+                    for(int t = 0; t < pool->T; t++)
+                        out[3+t] = pool->e[0]->myT[t];
+                    h[2] = 1;
+                    h[3] = out.size();
+                }
+                else if(op == srvStop)
+                {
+                    out.clear();
+                    h[2] = 0;
+                    h[3] = 0;
+                }
+                else
+                {
+                    pool->run(op,n,n ? &in[0] : NULL,n ? &out[0] : NULL);
+                    h[3] = pool->m(op);
+                }
+                if(!writeAll(fd,h,sizeof(h)) || (out.size() > 0 && !writeAll(fd,&out[0],out.size()*sizeof(double))))
+                    break;
+                if(op == srvStop)
+                {
+                    stop = true;
+                    shutdown(lfd,SHUT_RDWR);   // Wakes up accept.
+                    break;
+                }
+            }
+            lock_guard<mutex> lk(mx);
+            conn.erase(fd);
+            close(fd);
+            cv.notify_all();
+        }).detach();
+    }
+    // Stop: close the remaining connections and wait for their threads.
+    unique_lock<mutex> lk(mx);
+    for(set<int>::iterator it = conn.begin(); it != conn.end(); ++it)
+        shutdown(*it,SHUT_RDWR);
+    cv.wait(lk,[&conn]() { return conn.empty(); });
+    close(lfd);
+    unlink(myPath);
+}
+
+#endif /* SERVER_H */
@@ -0,0 +1,511 @@
+/*
+ * (C) Copyright 2017 Mariana Gómez-Schiavon
+ *
+ *    This file is part of BayFish.
+ *
+ *    BayFish is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    BayFish is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * BayFish pipeline
+ * SUMMARY: Streaming posterior summaries of the Metropolis Random Walk, so
+ *          the full parameter chain does not need to be post-processed.
+ *
+ * Summary : Online statistics updated once per MRW iteration.
+ *
+ *  class p2Quant(double myP) : P-square estimator (Jain & Chlamtac, 1985) of
+ *      the myP quantile using five markers, i.e. constant memory.
+ *      void add(double x) : Update the estimator with a new observation.
+ *      double value() : Current estimate of the quantile.
+ *
+ *  class myHist(double myLo, double myHi, int myNb, bool myLog) : Histogram
+ *      with myNb bins in [myLo,myHi] (in log10 scale if myLog); values out
+ *      of range are counted in the edge bins.
+ *      void add(double x, double f) : Count x with weight f (default 1).
+ *
+ *  class mrwSummary(int myT, double myPT, int myMaxU) : Running summaries of
+ *      the MRW; the table of unique sets has room for myMaxU of them.
+ *      int n : Number of iterations summarized (i.e. after burn-in).
+ *      double nW : Total weight of the summarized iterations (n, unless 
+ *          they are weighted).
+ *      int nAcc : Number of accepted proposals (new unique states).
+ *      int nUni : Number of unique parameter sets, i.e. with a different 
+ *          logarithmic bin, floor(log|p|/log(1+pT)), for some parameter p 
+ *          (not the rounding to pT times the mean of DATA_UniquePar.m); only 
+ *          the 64-bit (FNV-1a) hash of each set is stored, so two sets with 
+ *          the same hash are counted once (i.e. with probability ~nUni^2/2^65).
+ *      rowvec m : Mean of [pB,pS] parameters.
+ *      mat C : Covariance of [pB,pS] parameters.
+ *      rowvec mL : Mean log-likelihood per time point.
+ *
+ *      void add(const mat &pB, const mat &pS, const mat &L, double f) : 
+ *          Update all summaries with the current state of the chain; it does 
+ *          not allocate memory. f (default 1) is a frequency weight, e.g. the 
+ *          importance weight of a reweighted draw (see Reweight.h): means, 
+ *          covariances and histograms are weighted exactly, and the quantile 
+ *          estimators see the state floor(f+u) times (u ~ U(0,1)).
+ *
+ *      void accept() : Record that the current state is a new accepted
+ *          proposal.
+ *
+ *      void reserve(int nNew) : Grow (rehash) the table of unique sets, if 
+ *          needed, so that nNew more sets fit; called between checkpoints 
+ *          (e.g. with sumW), add does not allocate memory. Otherwise add 
+ *          grows the table when it is half full.
+ *
+ *      void write(char* myFile) : (Over)write the summary file.
+ *
+ *  class mrwICs(int myK, int myN) : Running quantities for the model
+ *      comparison criteria (see DATA_DIC.m, DATA_AIC.m and DATA_BIC.m).
+ *      int k : Number of free parameters.
+ *      int n : Sample size (i.e. number of cells over all time points).
+ *      double Dm : Mean deviance, -2*logL, over the summarized iterations.
+ *      double maxL : Maximum log-likelihood seen (proposals included).
+ *      mat bB, bS : Parameters with the maximum log-likelihood (i.e. the 
+ *          maximum likelihood estimate, MLE, among the evaluated sets).
+ *      double Dt : Deviance at the posterior mean parameters.
+ *
+ *      double nD : Total weight of the summarized iterations.
+ *
+ *      void add(double sL, double f) : Update the mean deviance with the 
+ *          log-likelihood of the current state (weight f, default 1).
+ *
+ *      void best(double sL, const mat &pB, const mat &pS) : Update the maximum
+ *          log-likelihood with an evaluated parameter set.
+ *
+ *      void write(char* myFile, const char* myModelCode, int s) : Append a 
+ *          row of the comparison table [DIC, AIC, AICc, BIC] to myFile; the 
+ *          row is identified by the model code (as in the output file names) 
+ *          and the seed, and ends with the MLE parameters bB, bS.
+ *
+ *  void printRow(ostream &out, const mat &A) : Writes the elements of A in
+ *      a single line (as raw_print), without temporary matrices.
+ *
+ *  Burst metrics (see DATA_BurstMetrics.m), for basal (B) and stimulus (S):
+ *      fB   : Fraction of ON promoters, kON/(kON+kOFF)
+ *      tON  : Burst (ON state) duration, 1/kOFF
+ *      tOFF : OFF state duration, 1/kON
+ *      amp  : Burst amplitude, (mu/kOFF)*(1-exp(-d/kOFF))
+ *
+ */
+
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+class p2Quant
+{
+public:
+    double p;
+    int n;
+    double q[5];    // Marker heights.
+    double np[5];   // Desired marker positions.
+    int ni[5];      // Actual marker positions.
+    double dn[5];   // Increments of desired positions.
+
+    p2Quant(double myP)
+    {
+        p = myP;
+        n = 0;
+        for(int i = 0; i < 5; i++)
+        {
+            q[i] = 0;
+            ni[i] = i+1;
+        }
+        np[0] = 1;
+        np[1] = 1+(2*p);
+        np[2] = 1+(4*p);
+        np[3] = 3+(2*p);
+        np[4] = 5;
+        dn[0] = 0;
+        dn[1] = p/2;
+        dn[2] = p;
+        dn[3] = (1+p)/2;
+        dn[4] = 1;
+    }
+
+    void add(double x)
+    {
+        if(n < 5)
+        {
+            q[n] = x;
+            n++;
+            if(n==5)
+                sort(q,q+5);
+            return;
+        }
+        n++;
+        int k;
+        if(x < q[0])
+        {
+            q[0] = x;
+            k = 0;
+        }
+        else if(x < q[1])
+            k = 0;
+        else if(x < q[2])
+            k = 1;
+        else if(x < q[3])
+            k = 2;
+        else if(x <= q[4])
+            k = 3;
+        else
+        {
+            q[4] = x;
+            k = 3;
+        }
+        for(int i = k+1; i < 5; i++)
+            ni[i]++;
+        for(int i = 0; i < 5; i++)
+            np[i] += dn[i];
+        // Adjust the heights of the three middle markers:
+        for(int i = 1; i <= 3; i++)
+        {
+            double d = np[i] - ni[i];
+            if((d >= 1 && (ni[i+1]-ni[i]) > 1) || (d <= -1 && (ni[i-1]-ni[i]) < -1))
+            {
+                int s = (d > 0) ? 1 : -1;
+                double qp = q[i] + (double(s)/(ni[i+1]-ni[i-1]))
+                        *(((ni[i]-ni[i-1]+s)*(q[i+1]-q[i])/(ni[i+1]-ni[i]))
+                        + ((ni[i+1]-ni[i]-s)*(q[i]-q[i-1])/(ni[i]-ni[i-1])));
+                if(q[i-1] < qp && qp < q[i+1])  // Parabolic prediction
+                    q[i] = qp;
+                else                            // Linear prediction
+                    q[i] = q[i] + (s*(q[i+s]-q[i])/(ni[i+s]-ni[i]));
+                ni[i] += s;
+            }
+        }
+    }
+
+    double value()
+    {
+        if(n==0)
+            return 0;
+        if(n < 5)
+        {
+            double temp[5];
+            copy(q,q+n,temp);
+            sort(temp,temp+n);
+            return temp[(int) floor(p*(n-1)+0.5)];
+        }
+        return q[2];
+    }
+};
+
+class myHist
+{
+public:
+    double lo, hi;
+    int nb;
+    bool lg;
+    vec h;
+
+    myHist(double myLo, double myHi, int myNb, bool myLog)
+    {
+        lo = myLo;
+        hi = myHi;
+        nb = myNb;
+        lg = myLog;
+        h.zeros(nb);
+    }
+
+    void add(double x, double f = 1)
+    {
+        if(!std::isfinite(x) || (lg && x <= 0))
+            return;
+        double v = lg ? log10(x) : x;
+        int b = (int) floor(nb*(v-lo)/(hi-lo));
+        b = std::max(0,std::min(nb-1,b));
+        h(b) += f;
+    }
+
+    double edge(int b)
+    {
+        return lo + (b*(hi-lo)/nb);
+    }
+};
+
+class mrwSummary
+{
+public:
+    int T;
+    int n;
+    int nAcc;
+    int nUni;
+    double nW;
+    double pT;
+    rowvec m;
+    mat C;
+    rowvec mL;
+    rowvec bM;      // Mean burst metrics [fB,tON,tOFF,amp] x [B,S].
+    rowvec bC;      // Unnormalized variance of the burst metrics.
+    vector<p2Quant> qP;
+    vector<myHist> hB;
+    vector<double> qs;
+    vector<unsigned long long> uH;  // Hash table of unique parameter sets.
+
+    mrwSummary(int myT, double myPT, int myMaxU)
+    {
+        T = myT;
+        pT = myPT;
+        n = 0;
+        nAcc = 0;
+        nUni = 0;
+        nW = 0;
+        m.zeros(16);
+        C.zeros(16,16);
+        mL.zeros(T);
+        bM.zeros(8);
+        bC.zeros(8);
+        // Hash table, at most half full (power of 2 for the mask in add):
+        uH.assign(2,0);
+        reserve(myMaxU);
+        double temp[5] = {0.025,0.25,0.5,0.75,0.975};
+        qs.assign(temp,temp+5);
+        for(int j = 0; j < 16; j++)
+            for(int k = 0; k < (int) qs.size(); k++)
+                qP.push_back(p2Quant(qs[k]));
+        for(int c = 0; c < 2; c++)
+        {
+            hB.push_back(myHist(0,1,100,false));    // fB
+            hB.push_back(myHist(-2,6,160,true));    // tON
+            hB.push_back(myHist(-2,6,160,true));    // tOFF
+            hB.push_back(myHist(-3,5,160,true));    // amp
+        }
+    }
+
+    void accept()
+    {
+        nAcc++;
+    }
+
+    void reserve(int nNew)
+    {
+        size_t nH = uH.size();
+        while(nH <= (2*((size_t) nUni + std::max(nNew,1))))
+            nH *= 2;
+        if(nH == uH.size())
+            return;
+        vector<unsigned long long> old(nH,0);
+        old.swap(uH);
+        for(size_t k = 0; k < old.size(); k++)
+        {
+            if(old[k] == 0)
+                continue;
+            size_t i = old[k] & (nH-1);
+            while(uH[i] != 0)
+                i = (i+1) & (nH-1);
+            uH[i] = old[k];
+        }
+    }
+
+    void add(const mat &pB, const mat &pS, const mat &L, double f = 1)
+    {
+        rowvec::fixed<16> x = join_rows(pB,pS);
+        n++;
+        nW += f;
+
+        // Mean & covariance (weighted Welford):
+        rowvec::fixed<16> delta = x - m;
+        m += delta*(f/nW);
+        for(int j = 0; j < 16; j++)
+            for(int k = 0; k < 16; k++)
+                C(j,k) += f*delta(j)*(x(k) - m(k));
+        for(int t = 0; t < T; t++)
+            mL(t) += f*(L(t) - mL(t))/nW;
+
+        // Quantiles (an unweighted state is added once, without drawing u):
+        int nQ = (f == 1) ? 1 : (int) floor(f + as_scalar(randu(1,1)));
+        for(int q = 0; q < nQ; q++)
+            for(int j = 0; j < 16; j++)
+                for(int k = 0; k < (int) qs.size(); k++)
+                    qP[(j*qs.size())+k].add(x(j));
+
+        // Burst metrics:
+        rowvec::fixed<8> b;
+        for(int c = 0; c < 2; c++)
+        {
+            double kON = x((c*8)+0);
+            double kOFF = x((c*8)+1);
+            double mu = x((c*8)+5);
+            double d = x((c*8)+7);
+            b((c*4)+0) = kON/(kON+kOFF);
+            b((c*4)+1) = 1/kOFF;
+            b((c*4)+2) = 1/kON;
+            b((c*4)+3) = (mu/kOFF)*(1-exp(-d/kOFF));
+            for(int k = 0; k < 4; k++)
+                hB[(c*4)+k].add(b((c*4)+k),f);
+        }
+        rowvec::fixed<8> bDelta = b - bM;
+        bM += bDelta*(f/nW);
+        bC += f*(bDelta % (b - bM));
+
+        // Unique parameter sets, by log bins of relative width pT (FNV-1a hash):
+        unsigned long long h = 14695981039346656037ULL;
+        for(int j = 0; j < 16; j++)
+        {
+            long long key = (x(j)==0) ? 0 : (long long) floor(log(fabs(x(j)))/log1p(pT));
+            h = (h ^ (unsigned long long) key)*1099511628211ULL;
+        }
+        h = (h==0) ? 1 : h;
+        if((2*((size_t) nUni+1)) >= uH.size())
+            reserve(1);
+        unsigned long long i = h & (uH.size()-1);
+        while(uH[i] != 0 && uH[i] != h)
+            i = (i+1) & (uH.size()-1);
+        if(uH[i] == 0)
+        {
+            uH[i] = h;
+            nUni++;
+        }
+    }
+
+    void write(char* myFile)
+    {
+        const char* pN[8] = {"kON","kOFF","kONs","kOFFs","mu0","mu","muS","d"};
+        const char* bN[4] = {"fB","tON","tOFF","amp"};
+        ofstream out(myFile,ios::out);
+        out.precision(6);
+        out << "Iterations " << n << endl;
+        if(nW != n)
+            out << "Weight " << nW << endl;
+        out << "Accepted " << nAcc << endl;
+        out << "Unique(pT=" << pT << ") " << nUni << endl;
+        out << "meanLogL";
+        for(int t = 0; t < T; t++)
+            out << ' ' << mL(t);
+        out << endl << endl;
+
+        // Parameters:
+        out << "Parameter mean std";
+        for(int k = 0; k < (int) qs.size(); k++)
+            out << " q" << qs[k];
+        out << endl;
+        for(int j = 0; j < 16; j++)
+        {
+            out << pN[j%8] << ((j<8) ? "_B" : "_S") << ' ' << m(j) << ' ';
+            out << ((nW>1) ? sqrt(C(j,j)/(nW-1)) : 0);
+            for(int k = 0; k < (int) qs.size(); k++)
+                out << ' ' << qP[(j*qs.size())+k].value();
+            out << endl;
+        }
+        out << endl << "Covariance" << endl;
+        mat temp = (nW>1) ? mat(C/(nW-1)) : mat(C);
+        temp.raw_print(out);
+
+        // Burst metrics:
+        out << endl << "BurstMetric mean std" << endl;
+        for(int k = 0; k < 8; k++)
+        {
+            out << bN[k%4] << ((k<4) ? "_B" : "_S") << ' ' << bM(k) << ' ';
+            out << ((nW>1) ? sqrt(bC(k)/(nW-1)) : 0) << endl;
+        }
+        for(int k = 0; k < 8; k++)
+        {
+            out << endl << "Histogram " << bN[k%4] << ((k<4) ? "_B" : "_S");
+            out << (hB[k].lg ? " log10" : "") << endl;
+            for(int i = 0; i < hB[k].nb; i++)
+                if(hB[k].h(i) > 0)
+                    out << hB[k].edge(i) << ' ' << hB[k].edge(i+1) << ' ' << setprecision(12) << hB[k].h(i) << setprecision(6) << endl;
+        }
+        out.close();
+    }
+};
+
+void printRow(ostream &out, const mat &A)
+{
+    for(uword j = 0; j < A.n_elem; j++)
+    {
+        out.width(out.precision()+6);
+        out << A(j);
+    }
+}
+
+class mrwICs
+{
+public:
+    int k;
+    int n;
+    double nD;
+    double Dm;
+    double maxL;
+    mat bB, bS;
+    double Dt;
+
+    mrwICs(int myK, int myN)
+    {
+        k = myK;
+        n = myN;
+        nD = 0;
+        Dm = 0;
+        maxL = -datum::inf;
+        bB.set_size(1,8);
+        bB.fill(datum::nan);
+        bS = bB;
+        Dt = datum::nan;
+    }
+
+    void add(double sL, double f = 1)
+    {
+        nD += f;
+        Dm += f*((-2*sL) - Dm)/nD;
+    }
+
+    void best(double sL, const mat &pB, const mat &pS)
+    {
+        if(sL > maxL)
+        {
+            maxL = sL;
+            bB = pB;
+            bS = pS;
+        }
+    }
+
+    void write(char* myFile, const char* myModelCode, int s)
+    {
+        ifstream temp(myFile);
+        bool isNew = !temp.good();
+        temp.close();
+        ofstream out(myFile,ios::app);
+        out.precision(8);
+        if(isNew)
+        {
+            out << "Model" << ' ' << "s" << ' ' << "k" << ' ';
+            out << "n" << ' ' << "maxL" << ' ' << "Dm" << ' ' << "Dt" << ' ';
+            out << "pD" << ' ' << "DIC" << ' ' << "AIC" << ' ' << "AICc";
+            out << ' ' << "BIC" << ' ' << "[B:kON...d]" << ' ' << "[S:kON...d]" << endl;
+        }
+        double aic = (-2*maxL) + (2*k);
+        out << myModelCode << ' ' << s << ' ' << k << ' ' << n << ' ';
+        out << maxL << ' ' << Dm << ' ' << Dt << ' ' << (Dm-Dt) << ' ';
+        out << (Dm+(Dm-Dt)) << ' ' << aic << ' ';
+        out << (aic+((2.0*k*(k+1))/(n-k-1))) << ' ';
+        out << ((-2*maxL)+(k*log((double) n)));
+        printRow(out,bB);
+        printRow(out,bS);
+        out << endl;
+        out.close();
+    }
+};
+
+#endif /* SUMMARY_H */
@@ -0,0 +1,72 @@
+#
+# (C) Copyright 2017 Mariana Gómez-Schiavon
+#
+#    This file is part of BayFish.
+#
+#    BayFish is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    BayFish is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with BayFish.  If not, see <http://www.gnu.org/licenses/>.
+#
+# BayFish pipeline
+# CLIENT: Query a likelihood server (see Server.h and Client.h) from Python.
+#
+#   c = BfClient("/tmp/bayfish.sock")
+#   L = c.logL(P)   # P: n x 16 parameter sets [pB, pS]; L: n x T
+#   D = c.dist(P)   # D: n x T x states
+#
+
+import socket
+import struct
+import numpy as np
+
+MAGIC = 0x48534642
+
+
+class BfClient:
+    def __init__(self, path):
+        self.s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.s.connect(path)
+        info = self.query(0, np.zeros((0, 16)))[0]
+        self.T, self.nS, self.maxM = int(info[0]), int(info[1]), int(info[2])
+        self.myT = info[3:].astype(int)
+
+    def _read(self, n):
+        b = bytearray()
+        while len(b) < n:
+            c = self.s.recv(n - len(b))
+            if not c:
+                raise ConnectionError("server closed the connection")
+            b.extend(c)
+        return bytes(b)
+
+    def query(self, op, P):
+        P = np.ascontiguousarray(P, dtype=np.float64)
+        if P.ndim not in (1, 2) or P.shape[-1] != 16:
+            raise ValueError("parameter sets must have 16 values, got shape %s" % (P.shape,))
+        P = P.reshape(-1, 16)
+        self.s.sendall(struct.pack("=4I", MAGIC, op, P.shape[0], 16) + P.tobytes())
+        _, status, n, m = struct.unpack("=4I", self._read(16))
+        if status != 0:
+            raise RuntimeError("request failed with status %d" % status)
+        return np.frombuffer(self._read(8 * n * m), dtype=np.float64).reshape(n, m)
+
+    def logL(self, P):
+        return self.query(1, P)
+
+    def dist(self, P):
+        return self.query(2, P).reshape(-1, self.T, self.nS)
+
+    def stop(self):
+        self.query(3, np.zeros((0, 16)))
+
+    def close(self):
+        self.s.close()
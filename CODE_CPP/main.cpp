@@ -33,7 +33,14 @@
 #include "Model.h"
 #include "ProbDistr.h"
 #include "MRW.h"
+#include "Summary.h"
+#include "MAP.h"
+#include "Hier.h"
+#include "Server.h"
+#include "Reweight.h"
+#include "Chain.h"
 #include <iomanip>
+#include <limits>
 
 
 using namespace std;
@@ -49,6 +56,14 @@ int main(int argc, char** argv)
     const int T = 4;          // Number of time points.
     int myT[T] = {0,5,15,25}; // Time points; only factors of 5 are allowed.
     int N = 2;                // Number of promoter states (2 or 3).
+    int K = 2;                // Gene copies (only if kronM).
+    bool kronM = false;       // If true, general K copies x N states model.
+    vec kX;                   // If kronM & N>3, fixed rates of states >= 3,
+                              // [kUP3,kDOWN3,...,mu3,...] (3*(N-3) values).
+    Mat<int> kE;              // If kronM, transitions of one copy, rows
+                              // [from,to,rate]: rate 0-3 is kON...kOFFs, 8+k
+                              // is kX(k), and the last N-3 values of kX are
+                              // mu3,... (empty: chain OFF<->ON<->ONs<->...).
     int maxM = 300;           // Maximum mRNA molecules.
     // Fixed biophysical parameters:
     Par pB;                   // ...in basal state.
@@ -56,10 +71,39 @@ int main(int argc, char** argv)
     Par pS = pB;              // ...after stimulus.
     // Data:
     double a = 0;             // If N='3S', threshold to define third TS state.
+    vec aX;                   // If kronM & N>3, thresholds of states >= 3.
     char* myDataCode = "Npas4"; // Code for data to load.
     // Metropolis Random Walk (MRW) parameters:
     int mrwI = 100000;        // Iterations.
     int mrwS = 7;             // Seed to use.
+    bool mrwRaw = true;       // If false, do not write the full chain.
+    bool mixP = false;        // If true, single precision sparse propagation.
+    bool itS = false;         // If true, warm-started iterative solvers
+                              // (no heap allocation in the MRW loop).
+    // Streaming summaries:
+    int sumB = 10000;         // Burn-in iterations excluded from summaries.
+    int sumW = 10000;         // Write the summary file every sumW iterations.
+    double sumPT = 0.01;      // Resolution to define unique parameter sets.
+    // Posterior mode (MAP) optimization before the MRW:
+    int mapN = 0;             // Multi-start optimizations (0: none).
+    int mapI = 2000;          // Maximum evaluations per optimization.
+    bool mapC = true;         // If true, MRW proposals from the Hessian.
+    int nThr = 4;             // Threads for parallel modes.
+    // Hierarchical multi-gene mode (replaces myDataCode & maxM):
+    int hgG = 0;              // Genes (0: single gene mode).
+    char* hgCode[] = {"Npas4","Fos"}; // Codes for data to load.
+    int hgMaxM[] = {300,300}; // Maximum mRNA molecules per gene.
+    bool hgD = true;          // If true, degradation rate shared by genes.
+    double zigD = 1e-6;       // MRW variance of the shared degradation rate.
+    bool hgPop = true;        // If true, log-normal population priors.
+    // Likelihood server mode (see Server.h):
+    bool srv = false;         // If true, answer queries instead of the MRW.
+    char* srvPath = "/tmp/bayfish.sock"; // Unix domain socket.
+    // Importance reweighting of a previous chain (see Reweight.h):
+    char* rwFile = "";        // Its *_Uniq.dat file ("": none).
+    int rwB = 10000;          // Burn-in iterations of the previous chain.
+    double rwE = 0.5;         // Rejuvenate (short MRW) if ESS/draws < rwE.
+    int rwI = 10000;          // Iterations of the rejuvenation MRW.
     // MRW sigma for parameter transition proposal in basal state:
     Par zigB;
     zigB.kON = 1e-5;
@@ -85,11 +129,60 @@ int main(int argc, char** argv)
     ////////////////////////////////////////////////////////////////////////////
     
     // Define model structure:
-    ModelStruct ms(N,maxM);
+    if(kronM && N > 3 && aX.n_elem != (uword) (N-3))
+    {
+        cout << "ERROR: N = " << N << " needs " << N-3 << " thresholds aX." << endl;
+        return 1;
+    }
+    if(!kronM && (N < 2 || N > 3))
+    {
+        cout << "ERROR: N > 3 is only defined with kronM = true." << endl;
+        return 1;
+    }
+    ModelStruct ms(kronM ? 2 : N,kronM ? 0 : maxM);   // Not used if kronM.
+    KronModel km(K,N,maxM,kX,kE);
+    if(kronM && !km.ok)     // Wrong kX or kE (see KronModel).
+        return 1;
+    char myModelCode[64];
+    if(kronM)
+        sprintf(myModelCode,"K%dN%d(%d)",K,N,maxM);
+    else
+        sprintf(myModelCode,"N%d(%d)",N,maxM);
+    if(rwFile[0] != 0)  // Keep the files of the previous chain.
+        strcat(myModelCode,"_RW");
     // Load data matrix:
     myData x[T];
+    vec aK(std::max(N-2,0));    // Thresholds between ON, ONs, ... states.
+    for(int j = 0; j < (int) aK.n_elem; j++)
+    {
+        aK(j) = (j == 0) ? a : aX(j-1);
+        if(j > 0 && aK(j) <= aK(j-1))
+        {
+            cout << "ERROR: The thresholds a, aX must increase." << endl;
+            return 1;
+        }
+    }
     for(int t = 0; t < T; t++)
-        x[t].loadData(N,maxM,a,myDataCode,myT[t]);
+    {
+        if(kronM)
+            x[t].loadDataK(&km.S,maxM,aK,myDataCode,myT[t]);
+        else
+            x[t].loadData(N,maxM,a,myDataCode,myT[t]);
+    }
+    // Likelihood server; model & data are loaded once:
+    if(srv)
+    {
+        vector<lxtEval*> e;
+        for(int k = 0; k < nThr; k++)
+            e.push_back(new lxtEval(&ms,kronM ? &km : NULL,x,T,myT,itS,mixP));
+        {
+            srvPool pool(e);
+            srvRun(srvPath,&pool,maxM);
+        }
+        for(int k = 0; k < nThr; k++)
+            delete e[k];
+        return 0;
+    }
     // Create MRW structure:
     arma_rng::set_seed(mrwS); // Set seed for random number generator.
     mrwPar mrw;
@@ -98,14 +191,121 @@ int main(int argc, char** argv)
     mrw.zigB = mrw.ParToMat(zigB);
     mrw.zigS = mrw.ParToMat(zigS);
     
+    // Hierarchical multi-gene mode (see Hier.h):
+    if(hgG > 0 && kronM)
+    {
+        cout << "ERROR: The hierarchical mode is only defined for the 2S & 3S models (kronM = false)." << endl;
+        return 1;
+    }
+    if(hgG > 0)
+    {
+        hgModel hm(hgG,hgCode,hgMaxM,N,a,T,myT,itS,mixP,nThr,sumPT,std::min(sumW,mrwI));
+        hm.hgD = hgD;
+        hm.zigD = zigD;
+        hm.hgPop = hgPop;
+        hm.sumB = sumB;
+        hm.init(mrw,mrw.ParToMat(lB_m),mrw.ParToMat(lB_M),
+                mrw.ParToMat(lS_m),mrw.ParToMat(lS_M));
+        if(mrwRaw)
+            hm.openUniq(N,mrwS);
+        char myHypFile[255];
+        strcpy (myHypFile,"MRW_HG_N%d_s%d_Hyp.dat");
+        sprintf(myHypFile,myHypFile,N,mrwS);
+        ofstream HGh(myHypFile,ios::out);
+        HGh.precision(6);
+        hm.writeHyp(HGh,0);
+        hm.writeHyp(HGh,1);
+        for(int i = 2; i <= mrwI; i++)
+        {
+            hm.sweep();
+            hm.writeHyp(HGh,i);
+            if(i > sumB)
+                for(int j = 0; j < hgG; j++)
+                    hm.g[j]->sum.add(hm.g[j]->mrw.pB,hm.g[j]->mrw.pS,hm.g[j]->L);
+            if((i%sumW)==0)
+            {
+                hm.writeSum(N,mrwS);
+                for(int j = 0; j < hgG; j++)
+                    hm.g[j]->sum.reserve(sumW);
+            }
+        }
+        hm.writeSum(N,mrwS);
+        hm.closeUniq();
+        cout << "Acceptance (genes): " << ((double) hm.nAcc)/(hgG*(mrwI-1));
+        cout << ", (shared d): " << ((double) hm.nAccD)/(mrwI-1) << endl;
+        return 0;
+    }
+    
+    // Importance reweighting; MRW only if the previous chain is not enough:
+    int rwJ = -1;   // Parameter set to start the rejuvenation MRW.
+    if(rwFile[0] != 0)
+    {
+        rwChain rw;
+        if(!rw.read(rwFile,rwB))
+        {
+            cout << "ERROR: Cannot read the chain " << rwFile << endl;
+            return 1;
+        }
+        vector<lxtEval*> e;
+        for(int k = 0; k < std::min(nThr,rw.n); k++)
+            e.push_back(new lxtEval(&ms,kronM ? &km : NULL,x,T,myT,itS,mixP));
+        rw.eval(e);
+        rw.weights();
+        char myRWFile[255];
+        strcpy (myRWFile,"MRW_");
+        strcat (myRWFile,myDataCode);
+        strcat (myRWFile,"_%s_s%d_W.dat");
+        sprintf(myRWFile,myRWFile,myModelCode,mrwS);
+        rw.write(myRWFile);
+        cout << "Reweighting: " << rw.n << " unique sets of " << accu(rw.c);
+        cout << " draws, ESS = " << rw.ESS << endl;
+        if(rw.ESS >= rwE*accu(rw.c))
+        {
+            // Summary & ICs of the weighted draws (as those of a MRW):
+            mrwSummary sum(T,sumPT,rw.n);
+            int nX = 0;     // Sample size.
+            for(int t = 0; t < T; t++)
+                nX += accu(x[t].data);
+            mrwICs ics(accu(mrw.zigB>0)+accu(mrw.zigS>0),nX);
+            rw.summarize(&sum,&ics);
+            strcpy (myRWFile,"MRW_");
+            strcat (myRWFile,myDataCode);
+            strcat (myRWFile,"_%s_s%d_Sum.dat");
+            sprintf(myRWFile,myRWFile,myModelCode,mrwS);
+            sum.write(myRWFile);
+            ParV mB = sum.m.cols(0,7);
+            ParV mS = sum.m.cols(8,15);
+            ics.Dt = -2*e[0]->eval(mB,mS);
+            strcpy (myRWFile,"MRW_");
+            strcat (myRWFile,myDataCode);
+            strcat (myRWFile,"_ICs.dat");
+            ics.write(myRWFile,myModelCode,mrwS);
+            for(unsigned int k = 0; k < e.size(); k++)
+                delete e[k];
+            return 0;
+        }
+        for(unsigned int k = 0; k < e.size(); k++)
+            delete e[k];
+        // Rejuvenation, from a draw of the reweighted chain:
+        rwJ = rw.sample();
+        mrw.pB = rw.pB[rwJ];
+        mrw.pS = rw.pS[rwJ];
+        mrwI = rwI;
+        sumB = 0;
+        sumW = std::min(sumW,rwI);
+        mapN = 0;
+    }
+    
     // OUTPUT FILES
     // Parameters:
     char myOutputFile[255];
     strcpy (myOutputFile,"MRW_");
     strcat (myOutputFile,myDataCode);
-    strcat (myOutputFile,"_N%d(%d)_s%d_Par.dat");
-    sprintf(myOutputFile,myOutputFile,N,maxM,mrwS);
-    ofstream MRWp(myOutputFile,ios::out);
+    strcat (myOutputFile,"_%s_s%d_Par.dat");
+    sprintf(myOutputFile,myOutputFile,myModelCode,mrwS);
+    ofstream MRWp;
+    if(mrwRaw)
+        MRWp.open(myOutputFile,ios::out);
     MRWp.precision(4);
     MRWp << "Iteration" << ' ' << "[B/S]" << ' ';
     MRWp << "kON" << ' ' << "kOFF" << ' ' << "kONs" << ' ' << "kOFFs" << ' ';
@@ -113,57 +313,154 @@ int main(int argc, char** argv)
     // Log-likelihoods:
     strcpy (myOutputFile,"MRW_");
     strcat (myOutputFile,myDataCode);
-    strcat (myOutputFile,"_N%d(%d)_s%d_logL.dat");
-    sprintf(myOutputFile,myOutputFile,N,maxM,mrwS);
-    ofstream MRWl(myOutputFile,ios::out);
+    strcat (myOutputFile,"_%s_s%d_logL.dat");
+    sprintf(myOutputFile,myOutputFile,myModelCode,mrwS);
+    ofstream MRWl;
+    if(mrwRaw)
+        MRWl.open(myOutputFile,ios::out);
     MRWl.precision(6);
     MRWl << "Iteration" << ' ';
     for(int t = 0; t < (T-1); t++)
         MRWl << "logL[" << t << "]" << ' ';
     MRWl << "logL[" << (T-1) << "]" << endl;
+    // Unique accepted states (i.e. run-length encoded chain):
+    strcpy (myOutputFile,"MRW_");
+    strcat (myOutputFile,myDataCode);
+    strcat (myOutputFile,"_%s_s%d_Uniq.dat");
+    sprintf(myOutputFile,myOutputFile,myModelCode,mrwS);
+    ofstream MRWu(myOutputFile,ios::out);
+    MRWu.precision(numeric_limits<double>::max_digits10);  // Exact round trip.
+    MRWu << "Iteration" << ' ' << "Dwell" << ' ';
+    for(int t = 0; t < T; t++)
+        MRWu << "logL[" << t << "]" << ' ';
+    MRWu << "[B:kON...d]" << ' ' << "[S:kON...d]" << endl;
+    // Summary:
+    char mySummaryFile[255];
+    strcpy (mySummaryFile,"MRW_");
+    strcat (mySummaryFile,myDataCode);
+    strcat (mySummaryFile,"_%s_s%d_Sum.dat");
+    sprintf(mySummaryFile,mySummaryFile,myModelCode,mrwS);
+    mrwSummary sum(T,sumPT,std::min(sumW,mrwI));    // Grown at every checkpoint.
+    // Model comparison table (appended; shared by all models of a data set):
+    char myICsFile[255];
+    strcpy (myICsFile,"MRW_");
+    strcat (myICsFile,myDataCode);
+    strcat (myICsFile,"_ICs.dat");
+    int nX = 0;     // Sample size.
+    for(int t = 0; t < T; t++)
+        nX += accu(x[t].data);
+    mrwICs ics(accu(mrw.zigB>0)+accu(mrw.zigS>0),nX);
     
     // First iteration:
-    mrw.initPar(mrw.ParToMat(lB_m),mrw.ParToMat(lB_M),  // Initialize parameters.
-            mrw.ParToMat(lS_m),mrw.ParToMat(lS_M));
-    MRWp << 1 <<' ' << "B" << ' ';
-    mrw.pB.raw_print(MRWp);
-    MRWp << 1 << ' ' << "S" << ' ';
-    mrw.pS.raw_print(MRWp);
-    
-    mat L(1,T);     // Log-likelihood per time point.
-    L = LxT(&ms,x,mrw.MatToPar(mrw.pB),mrw.MatToPar(mrw.pS),T,myT);
-    MRWl << 1 << ' ';
-    L.raw_print(MRWl);
+    if(mapN > 0)    // Start from the posterior mode (see MAP.h).
+    {
+        mapPar op(mrw);
+        op.nmI = mapI;
+        op.setBox(mrw.ParToMat(lB_m),mrw.ParToMat(lB_M),   // Search inside the initPar boxes.
+                mrw.ParToMat(lS_m),mrw.ParToMat(lS_M));
+        mat Y0(op.d,mapN);
+        vec y;
+        for(int j = 0; j < mapN; j++)   // Starting points, as initPar.
+        {
+            mrw.initPar(mrw.ParToMat(lB_m),mrw.ParToMat(lB_M),
+                    mrw.ParToMat(lS_m),mrw.ParToMat(lS_M));
+            op.toLog(mrw.pB,mrw.pS,&y);
+            Y0.col(j) = y;
+        }
+        vector<lxtEval*> e;
+        for(int k = 0; k < std::min(nThr,mapN); k++)
+            e.push_back(new lxtEval(&ms,kronM ? &km : NULL,x,T,myT,itS,mixP));
+        mat Y;
+        vec F;
+        mapMulti(&op,e,Y0,&Y,&F);
+        int jB = F.index_max();
+        op.toPar(Y.col(jB),&mrw.pB,&mrw.pS);
+        // List of local optima:
+        strcpy (myOutputFile,"MRW_");
+        strcat (myOutputFile,myDataCode);
+        strcat (myOutputFile,"_%s_s%d_MAP.dat");
+        sprintf(myOutputFile,myOutputFile,myModelCode,mrwS);
+        ofstream MRWm(myOutputFile,ios::out);
+        MRWm.precision(6);
+        MRWm << "Start" << ' ' << "logL" << ' ';
+        MRWm << "[B:kON...d]" << ' ' << "[S:kON...d]" << endl;
+        ParV qB, qS;
+        for(int j = 0; j < mapN; j++)
+        {
+            op.toPar(Y.col(j),&qB,&qS);
+            MRWm << (j+1) << ' ' << F(j);
+            printRow(MRWm,qB);
+            printRow(MRWm,qS);
+            MRWm << endl;
+        }
+        MRWm.close();
+        int nE = 0;
+        for(unsigned int k = 0; k < e.size(); k++)
+            nE += e[k]->nEval;
+        cout << "MAP logL: " << F(jB) << " (" << nE << " evaluations)" << endl;
+        if(mapC)
+        {
+            mat H;
+            hessLog(&op,e[0],Y.col(jB),&H);
+            if(!mapProp(&op,Y.col(jB),H,&mrw))
+                cout << "WARNING: Hessian at the mode is not positive definite; zigB & zigS are kept." << endl;
+        }
+        for(unsigned int k = 0; k < e.size(); k++)
+            delete e[k];
+    }
+    else if(rwJ < 0)
+        mrw.initPar(mrw.ParToMat(lB_m),mrw.ParToMat(lB_M),  // Initialize parameters.
+                mrw.ParToMat(lS_m),mrw.ParToMat(lS_M));
     
-    // Iterate:
+    // Iterate (see Chain.h); buffers are reused by every likelihood evaluation:
+    mrwChain ch(&ms,&km,x,T,myT,kronM,itS,mixP,&mrw,&sum,&ics,sumB,&MRWp,&MRWl,&MRWu);
+    ch.first();
     for(int i = 2; i <= mrwI; i++)
     {
-        mat ptB = mrw.ptB();
-        mat ptS = mrw.ptS(ptB);
-        if(min(min(join_cols(ptB+(mrw.pB==0),ptS+(mrw.pS==0))))>1e-8)
+        ch.step(i);
+        if((i%sumW)==0)
         {
-            mat Lt(1,T);
-            Lt = LxT(&ms,x,mrw.MatToPar(ptB),mrw.MatToPar(ptS),T,myT);
-            
-            // If proposal is accepted, update system:
-            mat r = randu(1,1);
-            mat alpha = min(join_rows(ones(1,1),exp(sum(Lt,1)-sum(L,1))),1);
-            if(r(0) <= alpha(0))
-            {
-                mrw.pB = ptB;
-                mrw.pS = ptS;
-                L = Lt;
-            }
+            sum.write(mySummaryFile);
+            sum.reserve(sumW);
         }
-        MRWp << i <<' ' << "B" << ' ';
-        mrw.pB.raw_print(MRWp);
-        MRWp << i << ' ' << "S" << ' ';
-        mrw.pS.raw_print(MRWp);
-        MRWl << i << ' ';
-        L.raw_print(MRWl);
+    }
+    ch.last(mrwI);
+    sum.write(mySummaryFile);
+    
+    // Model comparison; one likelihood evaluation at the posterior mean:
+    if(ics.nD > 0)
+    {
+        mat Lm;
+        if(kronM)
+            Lm = LxTk(&km,x,mrw.MatToPar(sum.m.cols(0,7)),
+                    mrw.MatToPar(sum.m.cols(8,15)),T,myT,&ch.is);
+        else
+            Lm = LxT(&ms,x,mrw.MatToPar(sum.m.cols(0,7)),
+                    mrw.MatToPar(sum.m.cols(8,15)),T,myT);
+        ics.Dt = -2*accu(Lm);
+    }
+    ics.write(myICsFile,myModelCode,mrwS);
+    if(mixP && !kronM)
+    {
+        cout << "Mixed precision fall-backs: " << ch.mp.nFB << "/" << ch.mp.nEval;
+        cout << ", double precision only (error bound): " << ch.mp.nDbl << endl;
+        if(ch.mp.nCmp > 0)
+        {
+            cout << "Mixed vs double precision (" << ch.mp.nCmp << " evaluations): time ";
+            cout << ch.mp.tMix/ch.mp.nCmp << " vs " << ch.mp.tDbl/ch.mp.nCmp << " s, speed-up ";
+            cout << ch.mp.tDbl/ch.mp.tMix << ", max |logL error| " << ch.mp.maxDL << endl;
+        }
+    }
+    if(itS || mixP || kronM)
+    {
+        cout << "Stationary solves: " << ch.is.nSolve << ", iterations per solve: ";
+        cout << ((double) ch.is.nIt)/ch.is.nSolve << ", fall-backs: " << ch.is.nFB << endl;
+        cout << "Transient steps: " << ch.is.nStep << ", products per step: ";
+        cout << ((double) ch.is.nMV)/ch.is.nStep << endl;
     }
     
     MRWp.close();
     MRWl.close();
+    MRWu.close();
   return 0;
   }